@@ -0,0 +1,156 @@
+#include "Compute.h"
+
+VkDescriptorSetLayout createStorageSetLayout(VkHandles &vk, uint32_t bindingCount, VkShaderStageFlags stages) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = stages;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings.data();
+    VkDescriptorSetLayout layout;
+    VK_CHECK(vkCreateDescriptorSetLayout(vk.device, &layoutInfo, nullptr, &layout));
+    return layout;
+}
+
+void writeStorageBuffers(VkHandles &vk, VkDescriptorSet set, std::vector<VkBuffer> const &buffers) {
+    std::vector<VkDescriptorBufferInfo> bufferInfos(buffers.size());
+    std::vector<VkWriteDescriptorSet> writes(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        bufferInfos[i].buffer = buffers[i];
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+        writes[i] = {};
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = (uint32_t)i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(vk.device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+}
+
+void VkComputePipeline::init(VkHandles &vk, char const *shader, std::vector<VkDescriptorSetLayout> const &setLayouts, uint32_t pushConstantSize) {
+    this->pushConstantSize = pushConstantSize;
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantSize;
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = (uint32_t)setLayouts.size();
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = pushConstantSize ? 1 : 0;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK(vkCreatePipelineLayout(vk.device, &layoutInfo, nullptr, &layout));
+
+    VkShaderModule module = loadShaderModule(vk, shader);
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = layout;
+    if (vkCreateComputePipelines(vk.device, vk.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error(std::string("failed to create compute pipeline for ") + shader);
+    }
+}
+
+void VkComputePipeline::destroy(VkHandles &vk) {
+    vkDestroyPipeline(vk.device, pipeline, nullptr);
+    vkDestroyPipelineLayout(vk.device, layout, nullptr);
+    pipeline = VK_NULL_HANDLE;
+    layout = VK_NULL_HANDLE;
+}
+
+void VkComputePipeline::bind(VkCommandBuffer commandBuffer, std::vector<VkDescriptorSet> const &sets) const {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    if (!sets.empty()) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, (uint32_t)sets.size(), sets.data(), 0, nullptr);
+    }
+}
+
+void VkComputeQueue::init(Vulkan &vulkan) {
+    VkHandles &vk = vulkan.handles;
+    this->vulkan = &vulkan;
+    commandPool = vk.createCommandPool(vk.computeFamily);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for (auto &f : frames) {
+        VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocInfo, &f.commandBuffer));
+        VK_CHECK(vkCreateSemaphore(vk.device, &semaphoreInfo, nullptr, &f.finished));
+    }
+    recordingFrame = UINT32_MAX;
+}
+
+void VkComputeQueue::destroy() {
+    VkHandles &vk = vulkan->handles;
+    for (auto &f : frames) {
+        vkDestroySemaphore(vk.device, f.finished, nullptr);
+    }
+    vkDestroyCommandPool(vk.device, commandPool, nullptr); // frees the command buffers
+}
+
+VkCommandBuffer VkComputeQueue::begin(uint32_t frame) {
+    if (recordingFrame != UINT32_MAX) {
+        throw std::runtime_error("compute frame begun twice without a submit");
+    }
+    recordingFrame = frame;
+    VkCommandBuffer commandBuffer = frames[frame].commandBuffer;
+    VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    return commandBuffer;
+}
+
+void VkComputeQueue::submit(VkPipelineStageFlags graphicsWaitStages, uint64_t waitFrames) {
+    if (recordingFrame == UINT32_MAX) {
+        throw std::runtime_error("compute submit without begin");
+    }
+    if (waitFrames && !vulkan->frameTimeline) {
+        throw std::runtime_error("waiting on earlier frames from the compute queue needs the frame timeline");
+    }
+    Frame &f = frames[recordingFrame];
+    recordingFrame = UINT32_MAX;
+    VK_CHECK(vkEndCommandBuffer(f.commandBuffer));
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &f.commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &f.finished;
+
+    // the dispatches may touch anything, so the wait is at the top
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    uint64_t signalValue = 0; // binary, ignored
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    if (waitFrames) {
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &vulkan->frameTimeline;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &waitFrames;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &signalValue;
+        submitInfo.pNext = &timelineInfo;
+    }
+    VK_CHECK(vkQueueSubmit(vulkan->handles.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+    vulkan->addFrameWait(f.finished, graphicsWaitStages);
+}
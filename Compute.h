@@ -0,0 +1,65 @@
+#pragma once
+#include "Vulkan.h"
+
+#include <array>
+#include <cassert>
+#include <vector>
+
+// descriptor set layout of bindingCount storage buffers at bindings 0..n-1, the usual compute shader inputs/outputs
+VkDescriptorSetLayout createStorageSetLayout(VkHandles &vk, uint32_t bindingCount, VkShaderStageFlags stages);
+// points binding i of set at the whole of buffers[i]
+void writeStorageBuffers(VkHandles &vk, VkDescriptorSet set, std::vector<VkBuffer> const &buffers);
+
+// A compute shader and its layout: descriptor set layouts (owned by the caller) plus
+// at most one push constant range starting at 0. The SPIR-V is loaded through the same
+// readFile/createShaderModule path as the graphics shaders and built with the pipeline cache.
+// Not tied to a queue: record it into graphics command buffers or into VkComputeQueue's.
+struct VkComputePipeline {
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    uint32_t pushConstantSize = 0;
+
+    void init(VkHandles &vk, char const *shader, std::vector<VkDescriptorSetLayout> const &setLayouts, uint32_t pushConstantSize = 0);
+    void destroy(VkHandles &vk);
+
+    void bind(VkCommandBuffer commandBuffer, std::vector<VkDescriptorSet> const &sets) const;
+    template <typename T>
+    void push(VkCommandBuffer commandBuffer, T const &constants) const {
+        assert(sizeof(T) <= pushConstantSize);
+        vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(T), &constants);
+    }
+    // enough groups of groupSize for invocations threads, the shader bounds checks the tail
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t invocations, uint32_t groupSize) const {
+        vkCmdDispatch(commandBuffer, (invocations + groupSize - 1) / groupSize, 1, 1);
+    }
+};
+
+// Async compute: per frame command buffers on the compute queue (VkHandles::computeQueue,
+// a family without graphics when the device has one, so dispatches overlap rasterization).
+// submit() signals the frame slot's semaphore and registers it with Vulkan::addFrameWait,
+// so the graphics submit of the same frame waits for the results at the stages that read
+// them. Anything older can be waited for on the frame timeline (waitFrames), which is how
+// compute work that writes data earlier frames still read orders itself after them.
+// Command buffers and semaphores are per frame slot: by the time the slot comes back round
+// its graphics frame has finished, and that frame waited on the compute submit.
+// Buffers both queues touch want VkHandles::createSharedBuffer (no ownership transfers).
+struct VkComputeQueue {
+    Vulkan *vulkan = nullptr;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    struct Frame {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkSemaphore finished = VK_NULL_HANDLE; // graphics waits on it
+    };
+    std::array<Frame, MAX_FRAMES_IN_FLIGHT> frames;
+    uint32_t recordingFrame = UINT32_MAX;
+
+    void init(Vulkan &vulkan);
+    void destroy();
+
+    // resets and begins the frame slot's command buffer
+    VkCommandBuffer begin(uint32_t frame);
+    // graphicsWaitStages: where the frame's graphics work first reads what the dispatches wrote.
+    // waitFrames > 0: the dispatches start only once graphics frames [0, waitFrames) are done, needs the frame timeline
+    void submit(VkPipelineStageFlags graphicsWaitStages, uint64_t waitFrames = 0);
+};
@@ -0,0 +1,126 @@
+#include "Culling.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SSE 1
+#endif
+
+FrustumPlanes FrustumPlanes::of(glm::mat4 const &viewProj) {
+    // Gribb/Hartmann: the planes are sums and differences of the matrix rows. glm is column major
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+    }
+    FrustumPlanes frustum;
+    frustum.planes[0] = rows[3] + rows[0]; // left
+    frustum.planes[1] = rows[3] - rows[0]; // right
+    frustum.planes[2] = rows[3] + rows[1]; // bottom
+    frustum.planes[3] = rows[3] - rows[1]; // top
+    frustum.planes[4] = rows[2];           // near, z >= 0
+    frustum.planes[5] = rows[3] - rows[2]; // far
+    for (auto &plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane.x, plane.y, plane.z));
+        plane = plane / length;
+    }
+    return frustum;
+}
+
+void FrustumCuller::init(ThreadPool *threads, uint32_t batchSize) {
+    this->threads = threads;
+    this->batchSize = (std::max(batchSize, 4u) + 3) & ~3u;
+}
+
+void FrustumCuller::cullBatch(std::vector<Model> const &models, FrustumPlanes const &frustum, uint32_t first, uint32_t end, std::vector<uint32_t> &out) {
+    out.clear();
+
+    // bounds to world space, the radius scaled by the transform's largest axis
+    for (uint32_t i = first; i < end; i++) {
+        Model const &m = models[i];
+        glm::vec4 center = m.transform * glm::vec4(m.boundsCenter, 1.0f);
+        float scale2 = std::max({glm::dot(glm::vec3(m.transform[0]), glm::vec3(m.transform[0])),
+                                 glm::dot(glm::vec3(m.transform[1]), glm::vec3(m.transform[1])),
+                                 glm::dot(glm::vec3(m.transform[2]), glm::vec3(m.transform[2]))});
+        centerX[i] = center.x;
+        centerY[i] = center.y;
+        centerZ[i] = center.z;
+        radius[i] = m.boundsRadius * std::sqrt(scale2);
+    }
+
+    // first is a multiple of 4 and the arrays are padded, so whole groups of 4 are safe to read
+#ifdef CULL_SSE
+    for (uint32_t i = first; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(&centerX[i]);
+        __m128 y = _mm_loadu_ps(&centerY[i]);
+        __m128 z = _mm_loadu_ps(&centerZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (auto const &p : frustum.planes) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_mul_ps(y, _mm_set1_ps(p.y))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        for (uint32_t mask = (uint32_t)_mm_movemask_ps(inside); mask; mask &= mask - 1) {
+            uint32_t index = i + std::countr_zero(mask);
+            if (index < end) {
+                out.push_back(index);
+            }
+        }
+    }
+#else
+    for (uint32_t i = first; i < end; i++) {
+        bool inside = true;
+        for (auto const &p : frustum.planes) {
+            inside &= centerX[i] * p.x + centerY[i] * p.y + centerZ[i] * p.z + p.w >= -radius[i];
+        }
+        if (inside) {
+            out.push_back(i);
+        }
+    }
+#endif
+}
+
+void FrustumCuller::cull(std::vector<Model> const &models, glm::mat4 const &viewProj) {
+    auto start = std::chrono::high_resolution_clock::now();
+    uint32_t count = (uint32_t)models.size();
+    uint32_t padded = (count + 3) & ~3u;
+    if (centerX.size() != padded) {
+        // padding spheres have -inf radius, they fail every plane
+        centerX.assign(padded, 0.0f);
+        centerY.assign(padded, 0.0f);
+        centerZ.assign(padded, 0.0f);
+        radius.assign(padded, -std::numeric_limits<float>::infinity());
+    }
+
+    FrustumPlanes frustum = FrustumPlanes::of(viewProj);
+    uint32_t batches = (count + batchSize - 1) / batchSize;
+    if (batchVisible.size() < batches) {
+        batchVisible.resize(batches); // kept between frames so the lists don't reallocate
+    }
+    auto task = [&](uint32_t b) {
+        cullBatch(models, frustum, b * batchSize, std::min(count, (b + 1) * batchSize), batchVisible[b]);
+    };
+    if (threads && batches > 1) {
+        threads->parallelFor(batches, task);
+    } else {
+        for (uint32_t b = 0; b < batches; b++) {
+            task(b);
+        }
+    }
+
+    visible.clear();
+    for (uint32_t b = 0; b < batches; b++) {
+        visible.insert(visible.end(), batchVisible[b].begin(), batchVisible[b].end());
+    }
+
+    stats.tested = count;
+    stats.visible = (uint32_t)visible.size();
+    stats.culled = count - stats.visible;
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    cullMs.add(stats.ms);
+}
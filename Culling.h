@@ -0,0 +1,50 @@
+#pragma once
+#include "Vulkan.h"
+#include "Scene.h"
+#include "Profiler.h"
+
+#include <vector>
+
+struct ThreadPool;
+
+#define DEFAULT_CULL_BATCH_SIZE 4096 // models per parallel job, a multiple of 4
+
+// the 6 clip planes of a view projection (Vulkan depth range, z in [0, w]), xyz normalized
+// so plane.xyz . p + plane.w is a distance, positive inside
+struct FrustumPlanes {
+    glm::vec4 planes[6];
+
+    static FrustumPlanes of(glm::mat4 const &viewProj);
+};
+
+struct CullStats {
+    uint32_t tested = 0;
+    uint32_t visible = 0;
+    uint32_t culled = 0;
+    double ms = 0; // world bounds update + test + compaction, last frame
+};
+
+// Frustum culls Models by their bounding spheres each frame and leaves the survivors'
+// indices in visible, in model order, for recordCommandBuffer to draw.
+// The world space spheres are kept as structure of arrays so one SSE load picks up the
+// same component of 4 models and every plane test runs on 4 models at once (scalar
+// fallback off x86). Large scenes are split into DEFAULT_CULL_BATCH_SIZE jobs on threads,
+// each compacting into its own list, and the lists are joined in order afterwards.
+struct FrustumCuller {
+    ThreadPool *threads = nullptr; // null: cull on the calling thread
+    uint32_t batchSize = DEFAULT_CULL_BATCH_SIZE;
+
+    // world space spheres, padded to a multiple of 4 with spheres that never pass
+    std::vector<float> centerX, centerY, centerZ, radius;
+    std::vector<std::vector<uint32_t>> batchVisible;
+    std::vector<uint32_t> visible;
+
+    CullStats stats;
+    RollingStats cullMs;
+
+    void init(ThreadPool *threads = nullptr, uint32_t batchSize = DEFAULT_CULL_BATCH_SIZE);
+    void cull(std::vector<Model> const &models, glm::mat4 const &viewProj);
+
+private:
+    void cullBatch(std::vector<Model> const &models, FrustumPlanes const &frustum, uint32_t first, uint32_t end, std::vector<uint32_t> &out);
+};
@@ -0,0 +1,56 @@
+#include "FileIO.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// flushes a closed file's data to disk, so a rename over the old file can't leave an empty or partial one after a crash
+static bool syncFile(std::string const &path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    bool synced = FlushFileBuffers(handle);
+    CloseHandle(handle);
+#else
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    synced = ::close(fd) == 0 && synced;
+#endif
+    return synced;
+}
+
+bool writeFileAtomic(std::string const &path, char const *what, std::function<void(std::ostream &)> const &write) {
+    std::string tmpPath = path + ".tmp" + std::to_string(std::random_device{}());
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    write(file);
+    file.close(); // the last of the data only reaches the file here, so check after it
+    std::error_code ec;
+    if (!file || !syncFile(tmpPath)) {
+        std::cout << "failed to write " << what << " " << tmpPath << "\n";
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+
+    // rename replaces the old file in one step
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cout << "failed to save " << what << " " << path << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+// Replaces path in one step: write() fills a temp file next to it (uniquely named, so
+// concurrent writers don't collide), which is closed, checked, synced to disk and then
+// renamed over path. A crash or failure at any point leaves the old file, never a torn
+// one, and no temp file behind. what names the file in the log. false on failure
+bool writeFileAtomic(std::string const &path, char const *what, std::function<void(std::ostream &)> const &write);
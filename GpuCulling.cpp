@@ -0,0 +1,187 @@
+#include "GpuCulling.h"
+#include "Culling.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "Upload.h"
+
+static GpuObject makeObject(Model const &model, MeshArena const &arena) {
+    MeshRange const &m = arena.get(model.mesh);
+    GpuObject object{};
+    object.transform = model.transform;
+    object.meshTransform = model.meshTransform;
+    object.sphere = glm::vec4(model.boundsCenter, model.boundsRadius);
+    object.indexCount = m.indexCount;
+    object.firstIndex = m.firstIndex;
+    object.vertexOffset = m.vertexOffset;
+    return object;
+}
+
+void VkGpuCuller::init(Vulkan &vulkan, uint32_t capacity, char const *cullShader, char const *vertexShader, char const *fragmentShader) {
+    VkHandles &vk = vulkan.handles;
+    if (!vk.drawIndirectFirstInstance) {
+        throw std::runtime_error("gpu culling needs the drawIndirectFirstInstance feature");
+    }
+    this->vk = &vk;
+    this->capacity = capacity;
+    objectCount = 0;
+
+    for (auto &f : frames) {
+        vk.createSharedBuffer((VkDeviceSize)capacity * sizeof(GpuObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, f.objectBuffer, f.objectMemory);
+        vk.createSharedBuffer((VkDeviceSize)capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, f.drawBuffer, f.drawMemory);
+        vk.createSharedBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, f.countBuffer, f.countMemory);
+    }
+
+    cullSetLayout = createStorageSetLayout(vk, 3, VK_SHADER_STAGE_COMPUTE_BIT);
+    objectSetLayout = createStorageSetLayout(vk, 1, VK_SHADER_STAGE_VERTEX_BIT);
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = 4 * MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 2 * MAX_FRAMES_IN_FLIGHT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    VK_CHECK(vkCreateDescriptorPool(vk.device, &poolInfo, nullptr, &descriptorPool));
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    for (auto &f : frames) {
+        allocInfo.pSetLayouts = &objectSetLayout;
+        VK_CHECK(vkAllocateDescriptorSets(vk.device, &allocInfo, &f.objectSet));
+        writeStorageBuffers(vk, f.objectSet, {f.objectBuffer});
+        allocInfo.pSetLayouts = &cullSetLayout;
+        VK_CHECK(vkAllocateDescriptorSets(vk.device, &allocInfo, &f.cullSet));
+        writeStorageBuffers(vk, f.cullSet, {f.objectBuffer, f.drawBuffer, f.countBuffer});
+    }
+
+    // cull: set 0 + the frustum as push constants
+    cullPipeline.init(vk, cullShader, {cullSetLayout}, sizeof(GpuCullConstants));
+
+    // draw: the frame uniforms like every graphics pipeline, then the objects
+    VkDescriptorSetLayout drawSetLayouts[] = {vulkan.render.descriptorSetLayout, objectSetLayout};
+    VkPipelineLayoutCreateInfo drawLayoutInfo{};
+    drawLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    drawLayoutInfo.setLayoutCount = 2;
+    drawLayoutInfo.pSetLayouts = drawSetLayouts;
+    VK_CHECK(vkCreatePipelineLayout(vk.device, &drawLayoutInfo, nullptr, &drawLayout));
+    drawPipeline = createPipelineWithLayout(vulkan, drawLayout, vertexShader, fragmentShader);
+}
+
+void VkGpuCuller::destroy() {
+    vkDestroyPipeline(vk->device, drawPipeline, nullptr);
+    vkDestroyPipelineLayout(vk->device, drawLayout, nullptr);
+    cullPipeline.destroy(*vk);
+    vkDestroyDescriptorPool(vk->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(vk->device, objectSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(vk->device, cullSetLayout, nullptr);
+    for (auto &f : frames) {
+        vk->destroyBuffer(f.objectBuffer, f.objectMemory);
+        vk->destroyBuffer(f.drawBuffer, f.drawMemory);
+        vk->destroyBuffer(f.countBuffer, f.countMemory);
+        f.pendingUpdates.clear();
+    }
+}
+
+void VkGpuCuller::setObjects(VkUploadBatch &uploads, std::vector<Model> const &models, MeshArena const &arena) {
+    if (models.size() > capacity) {
+        throw std::runtime_error("too many gpu culled objects, capacity is " + std::to_string(capacity));
+    }
+    std::vector<GpuObject> objects(models.size());
+    for (size_t i = 0; i < models.size(); i++) {
+        objects[i] = makeObject(models[i], arena);
+    }
+    for (auto &f : frames) {
+        if (!objects.empty()) {
+            uploads.uploadBuffer(objects.data(), objects.size() * sizeof(GpuObject), f.objectBuffer, 0, true); // shared with the compute queue
+        }
+        f.pendingUpdates.clear(); // older than what was just uploaded
+        f.uploadPending = true;
+    }
+    objectCount = (uint32_t)models.size();
+}
+
+void VkGpuCuller::updateObject(uint32_t index, Model const &model, MeshArena const &arena) {
+    GpuObject object = makeObject(model, arena);
+    for (auto &f : frames) {
+        f.pendingUpdates.push_back({index, object});
+    }
+}
+
+void VkGpuCuller::cull(VkCommandBuffer commandBuffer, uint32_t frame, glm::mat4 const &viewProj) {
+    record(commandBuffer, frame, viewProj, false);
+    frames[frame].uploadPending = false;
+}
+
+bool VkGpuCuller::cullAsync(Vulkan &vulkan, VkComputeQueue &compute, uint32_t frame, glm::mat4 const &viewProj) {
+    if (frames[frame].uploadPending || !vulkan.frameTimeline) {
+        return false;
+    }
+    // only the slot's previous frame read this copy of the objects (and it is the last one that wrote
+    // it on graphics). waitAndPrepForNextFrame already waited for it, so this never stalls the queue
+    uint64_t slotFreeAt = vulkan.frameNumber >= vulkan.render.framesInFlight ? vulkan.frameNumber - vulkan.render.framesInFlight + 1 : 0;
+    record(compute.begin(frame), frame, viewProj, true);
+    compute.submit(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, slotFreeAt);
+    return true;
+}
+
+// computeQueue: no graphics stages in the barriers, and the semaphore the graphics frame waits on replaces the final one
+void VkGpuCuller::record(VkCommandBuffer commandBuffer, uint32_t frame, glm::mat4 const &viewProj, bool computeQueue) {
+    Frame &f = frames[frame];
+    VkPipelineStageFlags readers = computeQueue ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+
+    // the slot's previous frame may still be culling or drawing with the objects being patched
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    if (!f.pendingUpdates.empty()) {
+        vkCmdPipelineBarrier(commandBuffer, readers, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+        for (auto &update : f.pendingUpdates) {
+            vkCmdUpdateBuffer(commandBuffer, f.objectBuffer, (VkDeviceSize)update.first * sizeof(GpuObject), sizeof(GpuObject), &update.second);
+        }
+        f.pendingUpdates.clear();
+    }
+    vkCmdFillBuffer(commandBuffer, f.countBuffer, 0, sizeof(uint32_t), 0);
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, readers, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    GpuCullConstants constants{};
+    FrustumPlanes frustum = FrustumPlanes::of(viewProj);
+    for (int i = 0; i < 6; i++) {
+        constants.planes[i] = frustum.planes[i];
+    }
+    constants.objectCount = objectCount;
+    constants.compact = compact() ? 1 : 0;
+    // uncompacted, every slot up to capacity is drawn so the unused ones have to say 0 instances
+    uint32_t invocations = compact() ? objectCount : capacity;
+
+    cullPipeline.bind(commandBuffer, {f.cullSet});
+    cullPipeline.push(commandBuffer, constants);
+    cullPipeline.dispatch(commandBuffer, invocations, GPU_CULL_GROUP_SIZE);
+
+    if (!computeQueue) {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+}
+
+void VkGpuCuller::draw(VkCommandBuffer commandBuffer, uint32_t frame, VkDescriptorSet uniformSet, uint32_t uniformOffset) {
+    Frame &f = frames[frame];
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+    VkDescriptorSet sets[] = {uniformSet, f.objectSet};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawLayout, 0, 2, sets, 1, &uniformOffset);
+
+    if (compact()) {
+        vk->cmdDrawIndexedIndirectCount(commandBuffer, f.drawBuffer, 0, f.countBuffer, 0, capacity, stride);
+    } else if (vk->multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(commandBuffer, f.drawBuffer, 0, capacity, stride);
+    } else {
+        for (uint32_t i = 0; i < capacity; i++) {
+            vkCmdDrawIndexedIndirect(commandBuffer, f.drawBuffer, (VkDeviceSize)i * stride, 1, stride);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "Vulkan.h"
+#include "Compute.h"
+
+#include <array>
+#include <vector>
+
+struct VkUploadBatch;
+struct MeshArena;
+struct Model;
+
+#define GPU_CULL_GROUP_SIZE 64 // local_size_x in shaders/comp/cull.glsl
+
+// one culled object, std430 layout shared with shaders/comp/cull.glsl and shaders/vert/gpu_culled.glsl
+struct GpuObject {
+    glm::mat4 transform;     // Model::transform, the sphere is culled in this space
+    glm::mat4 meshTransform; // Model::meshTransform, applied first when drawing
+    glm::vec4 sphere;        // model space bounding sphere, xyz center, w radius
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t pad;
+};
+static_assert(sizeof(GpuObject) == 160, "GpuObject must match the std430 struct in the shaders");
+
+// push constants of the cull shader
+struct GpuCullConstants {
+    glm::vec4 planes[6];
+    uint32_t objectCount;
+    uint32_t compact; // 1: survivors are packed at the front and counted, 0: one command per object, culled ones get instanceCount 0
+};
+
+// Frustum culling on the GPU for scenes too big for any per-object cpu work per frame.
+// Objects live in a device local storage buffer, uploaded once by setObjects and then
+// only patched for objects that changed (updateObject). Each frame cull() dispatches
+// shaders/comp/cull.glsl over all of them, which writes a VkDrawIndexedIndirectCommand
+// per visible object into the frame's draw buffer and bumps the count with an atomic.
+// draw() then issues them with one vkCmdDrawIndexedIndirectCount. firstInstance carries
+// the object index so the vertex shader (gpu_culled.glsl) can fetch its transform.
+// Needs drawIndirectFirstInstance. Without VK_KHR_draw_indirect_count the commands are
+// left uncompacted and all capacity slots are drawn, culled ones as 0 instance draws.
+// cullAsync() runs the same dispatch on a VkComputeQueue instead, so culling frame n
+// overlaps rendering frame n-1; the buffers are shared between the queue families.
+// Every frame slot has its own copy of the objects, so patching them only has to wait
+// for the slot's previous frame, not for everything still in flight.
+struct VkGpuCuller {
+    VkHandles *vk = nullptr;
+    uint32_t capacity = 0;
+    uint32_t objectCount = 0;
+
+    struct Frame {
+        VkBuffer objectBuffer = VK_NULL_HANDLE; // [capacity] GpuObject, this slot's copy
+        VkAllocation objectMemory;
+        VkDescriptorSet objectSet = VK_NULL_HANDLE;
+        std::vector<std::pair<uint32_t, GpuObject>> pendingUpdates; // applied by the slot's next cull
+        bool uploadPending = false; // setObjects' upload goes out with a graphics submit, after any compute submit
+        VkBuffer drawBuffer = VK_NULL_HANDLE; // [capacity] VkDrawIndexedIndirectCommand
+        VkAllocation drawMemory;
+        VkBuffer countBuffer = VK_NULL_HANDLE; // uint32_t draw count
+        VkAllocation countMemory;
+        VkDescriptorSet cullSet = VK_NULL_HANDLE;
+    };
+    std::array<Frame, MAX_FRAMES_IN_FLIGHT> frames;
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;   // objects, draws, count
+    VkDescriptorSetLayout objectSetLayout = VK_NULL_HANDLE; // set 1 of the draw pipeline: objects
+    VkComputePipeline cullPipeline;
+    VkPipelineLayout drawLayout = VK_NULL_HANDLE; // set 0 the frame uniforms, set 1 objects
+    VkPipeline drawPipeline = VK_NULL_HANDLE;
+
+    void init(Vulkan &vulkan, uint32_t capacity, char const *cullShader, char const *vertexShader, char const *fragmentShader);
+    void destroy();
+
+    // replaces every object, one upload per slot. models stay drawable by index in the same order
+    void setObjects(VkUploadBatch &uploads, std::vector<Model> const &models, MeshArena const &arena);
+    // re-sends one object, e.g. after its transform changed. cheap, only the object's bytes move (once per slot)
+    void updateObject(uint32_t index, Model const &model, MeshArena const &arena);
+
+    // outside the render pass, before draw()
+    void cull(VkCommandBuffer commandBuffer, uint32_t frame, glm::mat4 const &viewProj);
+    // cull() on the compute queue, the frame's graphics submit waits for it. false: this frame has to cull()
+    // on graphics instead, until every slot has seen setObjects' upload or without a frame timeline
+    bool cullAsync(Vulkan &vulkan, VkComputeQueue &compute, uint32_t frame, glm::mat4 const &viewProj);
+    // inside the render pass with the arena bound, rebinds set 0 at uniformOffset for its own layout
+    void draw(VkCommandBuffer commandBuffer, uint32_t frame, VkDescriptorSet uniformSet, uint32_t uniformOffset);
+
+private:
+    void record(VkCommandBuffer commandBuffer, uint32_t frame, glm::mat4 const &viewProj, bool computeQueue);
+    bool compact() const {
+        return vk->cmdDrawIndexedIndirectCount != nullptr;
+    }
+};
@@ -0,0 +1,217 @@
+#include "Memory.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void VkRangeAllocator::init(VkDeviceSize size) {
+    this->size = size;
+    used = 0;
+    freeRanges.clear();
+    freeRanges.push_back({0, size});
+}
+
+bool VkRangeAllocator::alloc(VkDeviceSize allocSize, VkDeviceSize alignment, VkDeviceSize &offset) {
+    for (size_t i = 0; i < freeRanges.size(); i++) {
+        Range r = freeRanges[i];
+        VkDeviceSize aligned = alignUp(r.offset, alignment);
+        VkDeviceSize padding = aligned - r.offset;
+        if (padding + allocSize > r.size) {
+            continue;
+        }
+
+        // split the free range into [padding][allocation][rest], dropping empty pieces
+        VkDeviceSize restOffset = aligned + allocSize;
+        VkDeviceSize restSize = r.offset + r.size - restOffset;
+        freeRanges.erase(freeRanges.begin() + i);
+        if (restSize > 0) {
+            freeRanges.insert(freeRanges.begin() + i, {restOffset, restSize});
+        }
+        if (padding > 0) {
+            freeRanges.insert(freeRanges.begin() + i, {r.offset, padding});
+        }
+
+        offset = aligned;
+        used += allocSize;
+        return true;
+    }
+    return false;
+}
+
+void VkRangeAllocator::free(VkDeviceSize offset, VkDeviceSize freeSize) {
+    auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](Range const &r, VkDeviceSize o) { return r.offset < o; });
+    it = freeRanges.insert(it, {offset, freeSize});
+    used -= freeSize;
+
+    // merge with the following range, then with the preceding one
+    auto next = it + 1;
+    if (next != freeRanges.end() && it->offset + it->size == next->offset) {
+        it->size += next->size;
+        freeRanges.erase(next);
+    }
+    if (it != freeRanges.begin()) {
+        auto prev = it - 1;
+        if (prev->offset + prev->size == it->offset) {
+            prev->size += it->size;
+            freeRanges.erase(it);
+        }
+    }
+}
+
+void VkRangeAllocator::grow(VkDeviceSize newSize) {
+    VkDeviceSize oldSize = size;
+    size = newSize;
+    used += newSize - oldSize; // free() takes it back off
+    free(oldSize, newSize - oldSize);
+}
+
+VkDeviceSize VkRangeAllocator::largestFreeRange() const {
+    VkDeviceSize largest = 0;
+    for (auto const &r : freeRanges) {
+        largest = std::max(largest, r.size);
+    }
+    return largest;
+}
+
+void VkAllocator::init(VkDevice device, VkPhysicalDevice physicalDevice) {
+    this->device = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    bufferImageGranularity = properties.limits.bufferImageGranularity;
+}
+
+// small heaps (integrated/cpu devices, the host visible BAR window) get proportionally smaller blocks
+VkDeviceSize VkAllocator::preferredBlockSize(uint32_t memoryTypeIndex) {
+    uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+    return std::min(blockSize, heapSize / 8);
+}
+
+uint32_t VkAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated) {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkMemoryBlock block;
+    VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &block.memory);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory block: " + std::to_string(result));
+    }
+    deviceAllocationCount++;
+
+    if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map device memory block!");
+        }
+    }
+    block.linear = linear;
+    block.dedicated = dedicated;
+    block.ranges.init(size);
+
+    // reuse a slot freed by an earlier block so outstanding blockIdx values stay valid
+    auto &typeBlocks = blocks[memoryTypeIndex];
+    for (uint32_t i = 0; i < typeBlocks.size(); i++) {
+        if (typeBlocks[i].memory == VK_NULL_HANDLE) {
+            typeBlocks[i] = block;
+            return i;
+        }
+    }
+    typeBlocks.push_back(block);
+    return (uint32_t)typeBlocks.size() - 1;
+}
+
+VkAllocation VkAllocator::allocate(uint32_t memoryTypeIndex, VkMemoryRequirements const &memRequirements, bool linear) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // with a granularity of 1 buffers and images can be packed together
+    bool separateByKind = bufferImageGranularity > 1;
+    VkDeviceSize preferredSize = preferredBlockSize(memoryTypeIndex);
+    auto &typeBlocks = blocks[memoryTypeIndex];
+
+    VkAllocation allocation;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.size = memRequirements.size;
+
+    uint32_t blockIdx = UINT32_MAX;
+    if (memRequirements.size > preferredSize / 2) {
+        blockIdx = createBlock(memoryTypeIndex, memRequirements.size, linear, true);
+        typeBlocks[blockIdx].ranges.alloc(memRequirements.size, 1, allocation.offset);
+    } else {
+        for (uint32_t i = 0; i < typeBlocks.size(); i++) {
+            auto &block = typeBlocks[i];
+            if (block.memory == VK_NULL_HANDLE || block.dedicated || (separateByKind && block.linear != linear)) {
+                continue;
+            }
+            if (block.ranges.alloc(memRequirements.size, memRequirements.alignment, allocation.offset)) {
+                blockIdx = i;
+                break;
+            }
+        }
+        if (blockIdx == UINT32_MAX) {
+            blockIdx = createBlock(memoryTypeIndex, preferredSize, linear, false);
+            typeBlocks[blockIdx].ranges.alloc(memRequirements.size, memRequirements.alignment, allocation.offset);
+        }
+    }
+
+    auto &block = typeBlocks[blockIdx];
+    allocation.memory = block.memory;
+    allocation.blockIdx = blockIdx;
+    if (block.mapped) {
+        allocation.mapped = (char *)block.mapped + allocation.offset;
+    }
+    allocationCount++;
+    return allocation;
+}
+
+void VkAllocator::free(VkAllocation &allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto &typeBlocks = blocks[allocation.memoryTypeIndex];
+    auto &block = typeBlocks[allocation.blockIdx];
+    block.ranges.free(allocation.offset, allocation.size);
+    allocationCount--;
+
+    // release empty blocks, but keep one shared block per type around to avoid thrashing
+    if (block.ranges.used == 0) {
+        bool keep = false;
+        if (!block.dedicated) {
+            keep = true;
+            for (uint32_t i = 0; i < typeBlocks.size(); i++) {
+                if (i != allocation.blockIdx && typeBlocks[i].memory != VK_NULL_HANDLE && !typeBlocks[i].dedicated && typeBlocks[i].linear == block.linear) {
+                    keep = false;
+                    break;
+                }
+            }
+        }
+        if (!keep) {
+            vkFreeMemory(device, block.memory, nullptr); // implicitly unmaps
+            block = VkMemoryBlock{};
+            deviceAllocationCount--;
+        }
+    }
+    allocation = VkAllocation{};
+}
+
+void VkAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &typeBlocks : blocks) {
+        for (auto &block : typeBlocks) {
+            if (block.memory != VK_NULL_HANDLE) {
+                vkFreeMemory(device, block.memory, nullptr);
+            }
+        }
+        typeBlocks.clear();
+    }
+    deviceAllocationCount = 0;
+    allocationCount = 0;
+}
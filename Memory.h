@@ -0,0 +1,66 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <array>
+#include <mutex>
+
+// A piece of one of VkAllocator's memory blocks. Bind resources at memory+offset.
+struct VkAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr; // host visible blocks stay mapped for their whole lifetime
+    uint32_t memoryTypeIndex = 0;
+    uint32_t blockIdx = 0;
+};
+
+// First-fit free list over [0, size). Free ranges are kept sorted by offset and
+// merged with their neighbours on free so the list stays short.
+struct VkRangeAllocator {
+    struct Range {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+    std::vector<Range> freeRanges;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+
+    void init(VkDeviceSize size);
+    bool alloc(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+    void free(VkDeviceSize offset, VkDeviceSize size);
+    void grow(VkDeviceSize newSize); // extends the range, the new tail is free
+    VkDeviceSize largestFreeRange() const;
+};
+
+struct VkMemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void *mapped = nullptr;
+    bool linear = true;     // buffers (linear) and optimal images never share a block, see bufferImageGranularity
+    bool dedicated = false; // a single allocation too big for a shared block
+    VkRangeAllocator ranges;
+};
+
+// Pools device memory into large blocks per memory type and sub-allocates out of them,
+// so creating a resource is a free list lookup instead of a vkAllocateMemory call.
+struct VkAllocator {
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    VkDeviceSize blockSize = 64 * 1024 * 1024;
+    std::array<std::vector<VkMemoryBlock>, VK_MAX_MEMORY_TYPES> blocks;
+    std::mutex mutex;
+
+    // stats
+    uint32_t deviceAllocationCount = 0; // live vkAllocateMemory allocations
+    uint32_t allocationCount = 0;       // live sub-allocations
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice);
+    VkAllocation allocate(uint32_t memoryTypeIndex, VkMemoryRequirements const &memRequirements, bool linear);
+    void free(VkAllocation &allocation);
+    void destroy();
+
+private:
+    VkDeviceSize preferredBlockSize(uint32_t memoryTypeIndex);
+    uint32_t createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated);
+};
@@ -0,0 +1,333 @@
+#include "Mesh.h"
+#include "Compute.h"
+#include "Uniforms.h"
+#include "Upload.h"
+
+#include <algorithm>
+
+void MeshArena::init(VkHandles &vk, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, VkIndexType indexType) {
+    this->vk = &vk;
+    this->vertexStride = vertexStride;
+    this->indexType = indexType;
+    createBuffers(vertexCapacity, indexCapacity, vertexBuffer, vertexMemory, indexBuffer, indexMemory);
+    vertexRanges.init(vertexCapacity);
+    indexRanges.init(indexCapacity);
+}
+
+void MeshArena::destroy() {
+    vk->destroyBuffer(vertexBuffer, vertexMemory);
+    vk->destroyBuffer(indexBuffer, indexMemory);
+    meshes.clear();
+    freeIds.clear();
+    pendingFrees.clear();
+}
+
+void MeshArena::createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity, VkBuffer &newVertexBuffer, VkAllocation &newVertexMemory, VkBuffer &newIndexBuffer, VkAllocation &newIndexMemory) {
+    // TRANSFER_SRC so growth and compaction can copy out of them. shared so those copies can run on the
+    // transfer queue with the uploads, no ownership to hand back and forth
+    vk->createSharedBuffer((VkDeviceSize)vertexCapacity * vertexStride, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, newVertexBuffer, newVertexMemory);
+    vk->createSharedBuffer((VkDeviceSize)indexCapacity * indexSize(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, newIndexBuffer, newIndexMemory);
+}
+
+// reallocate bigger buffers and copy the live meshes over, offsets stay the same. only live ranges:
+// the old free tail merges with the new space, a mesh added after this may land in it
+void MeshArena::grow(VkUploadBatch &uploads, uint32_t minVertexCapacity, uint32_t minIndexCapacity) {
+    uint32_t vertexCapacity = (uint32_t)std::max<VkDeviceSize>(vertexRanges.size * 2, minVertexCapacity);
+    uint32_t indexCapacity = (uint32_t)std::max<VkDeviceSize>(indexRanges.size * 2, minIndexCapacity);
+
+    VkBuffer newVertexBuffer, newIndexBuffer;
+    VkAllocation newVertexMemory, newIndexMemory;
+    createBuffers(vertexCapacity, indexCapacity, newVertexBuffer, newVertexMemory, newIndexBuffer, newIndexMemory);
+
+    uploads.transferBarrier(); // uploads recorded earlier may still be writing the old buffers
+    for (auto &m : meshes) {
+        if (!m.live) {
+            continue;
+        }
+        uploads.copySharedBuffer(vertexBuffer, newVertexBuffer, (VkDeviceSize)m.vertexCount * vertexStride, (VkDeviceSize)m.vertexOffset * vertexStride, (VkDeviceSize)m.vertexOffset * vertexStride);
+        uploads.copySharedBuffer(indexBuffer, newIndexBuffer, (VkDeviceSize)m.indexCount * indexSize(), (VkDeviceSize)m.firstIndex * indexSize(), (VkDeviceSize)m.firstIndex * indexSize());
+    }
+    uploads.transferBarrier(); // before anything written into the new buffers after this
+    uploads.retire(vertexBuffer, vertexMemory);
+    uploads.retire(indexBuffer, indexMemory);
+
+    vertexBuffer = newVertexBuffer;
+    vertexMemory = newVertexMemory;
+    indexBuffer = newIndexBuffer;
+    indexMemory = newIndexMemory;
+    vertexRanges.grow(vertexCapacity);
+    indexRanges.grow(indexCapacity);
+}
+
+uint32_t MeshArena::add(VkUploadBatch &uploads, void const *vertices, uint32_t vertexCount, uint32_t const *indices, uint32_t indexCount) {
+    if (indexType == VK_INDEX_TYPE_UINT32) {
+        return addRaw(uploads, vertices, vertexCount, indices, indexCount);
+    }
+    if (vertexCount > 65536) {
+        throw std::runtime_error("mesh has " + std::to_string(vertexCount) + " vertices, too many for a 16 bit index arena");
+    }
+    std::vector<uint16_t> narrowed(indices, indices + indexCount);
+    return addRaw(uploads, vertices, vertexCount, narrowed.data(), indexCount);
+}
+
+uint32_t MeshArena::add(VkUploadBatch &uploads, void const *vertices, uint32_t vertexCount, uint16_t const *indices, uint32_t indexCount) {
+    if (indexType == VK_INDEX_TYPE_UINT16) {
+        return addRaw(uploads, vertices, vertexCount, indices, indexCount);
+    }
+    std::vector<uint32_t> widened(indices, indices + indexCount);
+    return addRaw(uploads, vertices, vertexCount, widened.data(), indexCount);
+}
+
+uint32_t MeshArena::addRaw(VkUploadBatch &uploads, void const *vertices, uint32_t vertexCount, void const *indices, uint32_t indexCount) {
+    VkDeviceSize vertexOffset, firstIndex;
+    if (vertexRanges.largestFreeRange() < vertexCount || indexRanges.largestFreeRange() < indexCount) {
+        grow(uploads, (uint32_t)vertexRanges.size + vertexCount, (uint32_t)indexRanges.size + indexCount);
+    }
+    vertexRanges.alloc(vertexCount, 1, vertexOffset);
+    indexRanges.alloc(indexCount, 1, firstIndex);
+
+    uploads.uploadBuffer(vertices, (VkDeviceSize)vertexCount * vertexStride, vertexBuffer, vertexOffset * vertexStride, true);
+    uploads.uploadBuffer(indices, (VkDeviceSize)indexCount * indexSize(), indexBuffer, firstIndex * indexSize(), true);
+
+    MeshRange range{(uint32_t)firstIndex, indexCount, (int32_t)vertexOffset, vertexCount, true};
+    if (!freeIds.empty()) {
+        uint32_t id = freeIds.back();
+        freeIds.pop_back();
+        meshes[id] = range;
+        return id;
+    }
+    meshes.push_back(range);
+    return (uint32_t)meshes.size() - 1;
+}
+
+void MeshArena::remove(Vulkan &vulkan, uint32_t mesh) {
+    reclaim(vulkan);
+    MeshRange &m = meshes[mesh];
+    // frames [0, frameNumber) may draw it, an add() reusing the ranges before they finish would overwrite it under them
+    pendingFrees.push_back({m, vulkan.frameNumber});
+    m = MeshRange{0, 0, 0, 0, false};
+    freeIds.push_back(mesh);
+}
+
+void MeshArena::reclaim(Vulkan &vulkan) {
+    if (pendingFrees.empty()) {
+        return;
+    }
+    uint64_t completed = vulkan.completedFrames();
+    auto done = std::partition(pendingFrees.begin(), pendingFrees.end(), [completed](auto const &f) { return f.second > completed; });
+    for (auto it = done; it != pendingFrees.end(); it++) {
+        vertexRanges.free(it->first.vertexOffset, it->first.vertexCount);
+        indexRanges.free(it->first.firstIndex, it->first.indexCount);
+    }
+    pendingFrees.erase(done, pendingFrees.end());
+}
+
+static bool isPacked(VkRangeAllocator const &ranges) {
+    // packed means the only free space is the tail
+    return ranges.freeRanges.empty() || (ranges.freeRanges.size() == 1 && ranges.freeRanges[0].offset + ranges.freeRanges[0].size == ranges.size);
+}
+
+void MeshArena::compact(VkUploadBatch &uploads) {
+    if (pendingFrees.empty() && isPacked(vertexRanges) && isPacked(indexRanges)) {
+        return;
+    }
+
+    uint32_t vertexCapacity = (uint32_t)vertexRanges.size;
+    uint32_t indexCapacity = (uint32_t)indexRanges.size;
+    VkBuffer newVertexBuffer, newIndexBuffer;
+    VkAllocation newVertexMemory, newIndexMemory;
+    createBuffers(vertexCapacity, indexCapacity, newVertexBuffer, newVertexMemory, newIndexBuffer, newIndexMemory);
+
+    // copying inside one buffer can't overlap, so pack into fresh buffers instead of sliding in place
+    uploads.transferBarrier();
+    uint32_t vertexHead = 0, indexHead = 0;
+    for (auto &m : meshes) {
+        if (!m.live) {
+            continue;
+        }
+        uploads.copySharedBuffer(vertexBuffer, newVertexBuffer, (VkDeviceSize)m.vertexCount * vertexStride, (VkDeviceSize)m.vertexOffset * vertexStride, (VkDeviceSize)vertexHead * vertexStride);
+        uploads.copySharedBuffer(indexBuffer, newIndexBuffer, (VkDeviceSize)m.indexCount * indexSize(), (VkDeviceSize)m.firstIndex * indexSize(), (VkDeviceSize)indexHead * indexSize());
+        m.vertexOffset = (int32_t)vertexHead;
+        m.firstIndex = indexHead;
+        vertexHead += m.vertexCount;
+        indexHead += m.indexCount;
+    }
+    uploads.transferBarrier();
+    uploads.retire(vertexBuffer, vertexMemory);
+    uploads.retire(indexBuffer, indexMemory);
+
+    vertexBuffer = newVertexBuffer;
+    vertexMemory = newVertexMemory;
+    indexBuffer = newIndexBuffer;
+    indexMemory = newIndexMemory;
+
+    // what's still pending was left behind in the old buffers, which the in flight frames keep until the batch completes
+    pendingFrees.clear();
+    VkDeviceSize offset;
+    vertexRanges.init(vertexCapacity);
+    indexRanges.init(indexCapacity);
+    if (vertexHead > 0) {
+        vertexRanges.alloc(vertexHead, 1, offset);
+    }
+    if (indexHead > 0) {
+        indexRanges.alloc(indexHead, 1, offset);
+    }
+}
+
+void MeshArena::bind(VkCommandBuffer commandBuffer) {
+    VkBuffer vertexBuffers[] = {vertexBuffer};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+}
+
+void IndirectDraws::init(Vulkan &vulkan, uint32_t maxDraws, char const *vertexShader, char const *fragmentShader) {
+    VkHandles &vk = vulkan.handles;
+    this->vk = &vk;
+    this->maxDraws = maxDraws;
+    transformed = vk.drawIndirectFirstInstance;
+    // host coherent so writes need no flush, vkQueueSubmit makes them visible to the draw
+    for (auto &f : frames) {
+        vk.createBuffer(countOffset() + sizeof(uint32_t), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, f.buffer, f.memory);
+        if (transformed) {
+            vk.createBuffer((VkDeviceSize)maxDraws * sizeof(glm::mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, f.transformBuffer, f.transformMemory);
+        }
+    }
+
+    // same push constant range as VkRender::pipelineLayout, so set 0 stays compatible with the other pipelines
+    transformSetLayout = createStorageSetLayout(vk, 1, VK_SHADER_STAGE_VERTEX_BIT);
+    VkDescriptorSetLayout setLayouts[] = {vulkan.render.descriptorSetLayout, transformSetLayout};
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawPushConstants);
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 2;
+    layoutInfo.pSetLayouts = setLayouts;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK(vkCreatePipelineLayout(vk.device, &layoutInfo, nullptr, &drawLayout));
+    if (!transformed) {
+        return;
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    VK_CHECK(vkCreateDescriptorPool(vk.device, &poolInfo, nullptr, &descriptorPool));
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &transformSetLayout;
+    for (auto &f : frames) {
+        VK_CHECK(vkAllocateDescriptorSets(vk.device, &allocInfo, &f.transformSet));
+        writeStorageBuffers(vk, f.transformSet, {f.transformBuffer});
+    }
+    drawPipeline = createPipelineWithLayout(vulkan, drawLayout, vertexShader, fragmentShader);
+}
+
+void IndirectDraws::destroy() {
+    if (transformed) {
+        vkDestroyPipeline(vk->device, drawPipeline, nullptr);
+        vkDestroyDescriptorPool(vk->device, descriptorPool, nullptr);
+    }
+    vkDestroyPipelineLayout(vk->device, drawLayout, nullptr);
+    vkDestroyDescriptorSetLayout(vk->device, transformSetLayout, nullptr);
+    for (auto &f : frames) {
+        vk->destroyBuffer(f.buffer, f.memory);
+        if (transformed) {
+            vk->destroyBuffer(f.transformBuffer, f.transformMemory);
+        }
+    }
+}
+
+void IndirectDraws::begin(uint32_t frameIdx) {
+    frame = frameIdx;
+    drawCount = 0;
+}
+
+void IndirectDraws::add(MeshArena const &arena, uint32_t mesh, glm::mat4 const &transform) {
+    if (drawCount == maxDraws) {
+        throw std::runtime_error("too many indirect draws, max is " + std::to_string(maxDraws));
+    }
+    Frame &f = frames[frame];
+    uint32_t firstInstance = 0;
+    if (transformed) {
+        firstInstance = drawCount;
+        ((glm::mat4 *)f.transformMemory.mapped)[firstInstance] = transform;
+    } else if (transform != glm::mat4(1.0f)) {
+        throw std::runtime_error("indirect draws with transforms need the drawIndirectFirstInstance feature");
+    }
+    MeshRange const &m = arena.get(mesh);
+    auto *commands = (VkDrawIndexedIndirectCommand *)f.memory.mapped;
+    commands[drawCount++] = {m.indexCount, 1, m.firstIndex, m.vertexOffset, firstInstance};
+}
+
+void IndirectDraws::draw(VkCommandBuffer commandBuffer, VkDescriptorSet uniformSet, uint32_t uniformOffset) {
+    Frame &f = frames[frame];
+    uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    *(uint32_t *)((char *)f.memory.mapped + countOffset()) = drawCount;
+
+    if (transformed) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+        VkDescriptorSet sets[] = {uniformSet, f.transformSet};
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawLayout, 0, 2, sets, 1, &uniformOffset);
+    } else {
+        // the caller's pipeline, the push constant ranges match
+        DrawPushConstants identity;
+        vkCmdPushConstants(commandBuffer, drawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(identity), &identity);
+    }
+
+    if (vk->cmdDrawIndexedIndirectCount) {
+        vk->cmdDrawIndexedIndirectCount(commandBuffer, f.buffer, 0, f.buffer, countOffset(), maxDraws, stride);
+    } else if (vk->multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(commandBuffer, f.buffer, 0, drawCount, stride);
+    } else {
+        // without multiDrawIndirect drawCount is limited to 1, still no per-draw state on the cpu
+        for (uint32_t i = 0; i < drawCount; i++) {
+            vkCmdDrawIndexedIndirect(commandBuffer, f.buffer, (VkDeviceSize)i * stride, 1, stride);
+        }
+    }
+}
+
+void InstanceBuffer::init(VkHandles &vk, uint32_t capacity) {
+    this->vk = &vk;
+    this->capacity = capacity;
+    for (auto &f : frames) {
+        vk.createBuffer((VkDeviceSize)capacity * sizeof(InstanceData), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, f.buffer, f.memory);
+    }
+}
+
+void InstanceBuffer::destroy() {
+    for (auto &f : frames) {
+        vk->destroyBuffer(f.buffer, f.memory);
+    }
+}
+
+void InstanceBuffer::begin(uint32_t frameIdx) {
+    frame = frameIdx;
+    count = 0;
+}
+
+uint32_t InstanceBuffer::push(InstanceData const *instances, uint32_t instanceCount) {
+    if (count + instanceCount > capacity) {
+        throw std::runtime_error("too many instances, capacity is " + std::to_string(capacity));
+    }
+    uint32_t firstInstance = count;
+    memcpy((InstanceData *)frames[frame].memory.mapped + firstInstance, instances, instanceCount * sizeof(InstanceData));
+    count += instanceCount;
+    return firstInstance;
+}
+
+void InstanceBuffer::bind(VkCommandBuffer commandBuffer) {
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 1, 1, &frames[frame].buffer, &offset);
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "Vulkan.h"
+
+#include <vector>
+#include <array>
+
+struct VkUploadBatch;
+
+// where a mesh lives inside a MeshArena, everything vkCmdDrawIndexed needs
+struct MeshRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+    bool live;
+};
+
+// Packs many meshes into one vertex buffer and one index buffer so a frame binds them
+// once and each mesh is just offsets into the shared buffers. Indices stay relative to
+// the mesh's vertexOffset, so meshes can be moved around without rewriting them.
+// Ranges are tracked in vertices/indices with the same free list VkAllocator uses.
+// A 16 bit arena halves the index memory and still holds any number of meshes, the
+// limit is 65536 vertices per mesh since vertexOffset is added after the index fetch.
+//
+// add/compact record their copies into an upload batch, all on the queue the batch
+// stages on (the buffers are shared across queue families) with transfer barriers
+// around growth and compaction, so those stay ordered with the uploads next to them.
+// Buffers replaced by growth or compaction are released when that batch completes,
+// which covers frames submitted before it on the same queue. Don't call them while a
+// frame that has already bound the arena is being recorded.
+struct MeshArena {
+    VkHandles *vk = nullptr;
+    uint32_t vertexStride = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkAllocation vertexMemory;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkAllocation indexMemory;
+    VkRangeAllocator vertexRanges; // in vertices
+    VkRangeAllocator indexRanges;  // in indices
+
+    std::vector<MeshRange> meshes; // indexed by mesh id
+    std::vector<uint32_t> freeIds;
+    std::vector<std::pair<MeshRange, uint64_t>> pendingFrees; // removed ranges and the frame count after which nothing draws them
+
+    void init(VkHandles &vk, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, VkIndexType indexType = VK_INDEX_TYPE_UINT32);
+    void destroy();
+
+    // returns the mesh id. indices are converted to the arena's indexType if they don't match
+    uint32_t add(VkUploadBatch &uploads, void const *vertices, uint32_t vertexCount, uint32_t const *indices, uint32_t indexCount);
+    uint32_t add(VkUploadBatch &uploads, void const *vertices, uint32_t vertexCount, uint16_t const *indices, uint32_t indexCount);
+    // the id is reusable right away, the ranges only once the frames submitted so far are done (reclaim)
+    void remove(Vulkan &vulkan, uint32_t mesh);
+    // frees the ranges of removed meshes no frame in flight can still draw. drawFrame calls it for Scene::arena
+    void reclaim(Vulkan &vulkan);
+    // moves all live meshes to the front of fresh buffers, squeezing out the holes left by remove()
+    void compact(VkUploadBatch &uploads);
+
+    uint32_t indexSize() const {
+        return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
+    MeshRange const &get(uint32_t mesh) const {
+        return meshes[mesh];
+    }
+
+    // bind once per command buffer, then draw any number of meshes
+    void bind(VkCommandBuffer commandBuffer);
+    void draw(VkCommandBuffer commandBuffer, uint32_t mesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0) {
+        MeshRange const &m = meshes[mesh];
+        vkCmdDrawIndexed(commandBuffer, m.indexCount, instanceCount, m.firstIndex, m.vertexOffset, firstInstance);
+    }
+
+private:
+    void createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity, VkBuffer &newVertexBuffer, VkAllocation &newVertexMemory, VkBuffer &newIndexBuffer, VkAllocation &newIndexMemory);
+    void grow(VkUploadBatch &uploads, uint32_t minVertexCapacity, uint32_t minIndexCapacity);
+    uint32_t addRaw(VkUploadBatch &uploads, void const *vertices, uint32_t vertexCount, void const *indices, uint32_t indexCount); // indices already in indexType
+};
+
+// GPU-driven alternative to calling MeshArena::draw per mesh: draws are written as
+// VkDrawIndexedIndirectCommand records into a persistently mapped buffer per frame in
+// flight and the whole list goes out in one vkCmdDrawIndexedIndirect(Count), so the
+// cpu cost of recording stays flat however many meshes are drawn.
+// The draw count lives in the same buffer after the commands, so a compute pass can
+// later rewrite both and the count variant picks it up.
+// Each draw's transform goes into a per-frame storage buffer next to the commands and
+// its firstInstance is its index there, so the vertex shader (indirect.glsl) fetches it
+// the way gpu_culled.glsl fetches its object. That needs drawIndirectFirstInstance;
+// without it draws use the caller's pipeline with an identity push constant and add()
+// rejects any other transform.
+struct IndirectDraws {
+    VkHandles *vk = nullptr;
+    uint32_t maxDraws = 0;
+    bool transformed = false; // drawIndirectFirstInstance: per-draw transforms
+
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE; // [maxDraws commands][draw count]
+        VkAllocation memory;
+        VkBuffer transformBuffer = VK_NULL_HANDLE; // [maxDraws] mat4, indexed by firstInstance
+        VkAllocation transformMemory;
+        VkDescriptorSet transformSet = VK_NULL_HANDLE;
+    };
+    std::array<Frame, MAX_FRAMES_IN_FLIGHT> frames;
+    uint32_t frame = 0;
+    uint32_t drawCount = 0;
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout transformSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout drawLayout = VK_NULL_HANDLE; // set 0 the frame uniforms, set 1 the transforms, DrawPushConstants like VkRender::pipelineLayout
+    VkPipeline drawPipeline = VK_NULL_HANDLE;
+
+    void init(Vulkan &vulkan, uint32_t maxDraws, char const *vertexShader, char const *fragmentShader);
+    void destroy();
+
+    // start a new list in frameIdx's buffer, call once the frame's inFlightFence has signaled
+    void begin(uint32_t frameIdx);
+    // transform: model to world, e.g. Model::transform * Model::meshTransform
+    void add(MeshArena const &arena, uint32_t mesh, glm::mat4 const &transform = glm::mat4(1.0f));
+    // issue everything added since begin(), bind the arena first. rebinds set 0 at uniformOffset for its own layout
+    void draw(VkCommandBuffer commandBuffer, VkDescriptorSet uniformSet, uint32_t uniformOffset);
+
+    VkDeviceSize countOffset() const {
+        return (VkDeviceSize)maxDraws * sizeof(VkDrawIndexedIndirectCommand);
+    }
+};
+
+// Per-instance data for the instanced pipeline (InstanceData, vertex binding 1), rewritten
+// every frame into a persistently mapped buffer per frame in flight. push() hands back
+// the firstInstance to pass to MeshArena::draw, so any number of instanced meshes can
+// share the buffer and a single bind.
+struct InstanceBuffer {
+    VkHandles *vk = nullptr;
+    uint32_t capacity = 0;
+
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkAllocation memory;
+    };
+    std::array<Frame, MAX_FRAMES_IN_FLIGHT> frames;
+    uint32_t frame = 0;
+    uint32_t count = 0;
+
+    void init(VkHandles &vk, uint32_t capacity);
+    void destroy();
+
+    // start filling frameIdx's buffer, call once the frame's inFlightFence has signaled
+    void begin(uint32_t frameIdx);
+    // copies the instances in and returns their firstInstance
+    uint32_t push(InstanceData const *instances, uint32_t instanceCount);
+    void bind(VkCommandBuffer commandBuffer);
+};
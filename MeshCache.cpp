@@ -0,0 +1,272 @@
+#include "MeshCache.h"
+#include "FileIO.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::open(char const *path) {
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)) {
+        CloseHandle(handle);
+        return false;
+    }
+    file = handle;
+    size = (size_t)fileSize.QuadPart;
+    if (size == 0) {
+        return true; // can't map an empty file, there's nothing to read anyway
+    }
+    mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    data = nullptr;
+    mapping = file = nullptr;
+    size = 0;
+}
+#else
+bool MappedFile::open(char const *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size = (size_t)st.st_size;
+    if (size > 0) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = mapped == MAP_FAILED ? nullptr : mapped;
+    }
+    ::close(fd); // the mapping keeps the file alive
+    if (size > 0 && !data) {
+        size = 0;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (data) {
+        munmap((void *)data, size);
+    }
+    data = nullptr;
+    size = 0;
+}
+#endif
+
+uint64_t hashBytes(void const *data, size_t size) {
+    auto const *bytes = (unsigned char const *)data;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h = (h ^ (word * 0xbf58476d1ce4e5b9ull)) * 0x94d049bb133111ebull;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    }
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static uint32_t indexSize(uint32_t indexType) {
+    return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+MeshBounds MeshCacheFile::bounds() const {
+    MeshBounds bounds;
+    bounds.center = glm::vec3(header->boundsCenter[0], header->boundsCenter[1], header->boundsCenter[2]);
+    bounds.halfExtent = glm::vec3(header->boundsHalfExtent[0], header->boundsHalfExtent[1], header->boundsHalfExtent[2]);
+    return bounds;
+}
+
+void MeshCacheFile::close() {
+    file.close();
+    header = nullptr;
+}
+
+bool openMeshCache(MeshCacheFile &cache, std::string const &path) {
+    cache.path = path;
+    if (!cache.file.open(path.c_str())) {
+        return false;
+    }
+    auto const *header = (MeshCacheHeader const *)cache.file.data;
+    size_t size = cache.file.size;
+    bool valid = size >= sizeof(MeshCacheHeader)
+        && header->magic == MESH_CACHE_MAGIC
+        && header->version == MESH_CACHE_VERSION
+        && header->vertexStride == sizeof(Vertex)
+        && (header->indexType == VK_INDEX_TYPE_UINT16 || header->indexType == VK_INDEX_TYPE_UINT32)
+        && header->vertexBytesOffset % MESH_CACHE_ALIGNMENT == 0 && header->indexBytesOffset % MESH_CACHE_ALIGNMENT == 0
+        && header->vertexBytesOffset + (uint64_t)header->vertexCount * header->vertexStride <= size
+        && header->indexBytesOffset + (uint64_t)header->indexCount * indexSize(header->indexType) <= size;
+    if (!valid) {
+        cache.file.close();
+        return false;
+    }
+    cache.header = header;
+    return true;
+}
+
+// header, then the blobs at the offsets it gives
+static bool writeCacheFile(std::string const &path, MeshCacheHeader const &header, void const *vertices, void const *indices) {
+    uint64_t vertexBytes = (uint64_t)header.vertexCount * header.vertexStride;
+    uint64_t indexBytes = (uint64_t)header.indexCount * indexSize(header.indexType);
+    char const padding[MESH_CACHE_ALIGNMENT] = {};
+
+    return writeFileAtomic(path, "mesh cache", [&](std::ostream &file) {
+        file.write((char const *)&header, sizeof(header));
+        file.write(padding, header.vertexBytesOffset - sizeof(header));
+        file.write((char const *)vertices, vertexBytes);
+        file.write(padding, header.indexBytesOffset - header.vertexBytesOffset - vertexBytes);
+        file.write((char const *)indices, indexBytes);
+    });
+}
+
+bool writeMeshCache(std::string const &path, ObjMesh const &mesh, MeshCacheSource const &source) {
+    MeshBounds bounds = MeshBounds::of(mesh.vertices);
+    MeshCacheHeader header{};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = source.hash;
+    header.sourceSize = source.size;
+    header.sourceMtime = source.mtime;
+    header.vertexStride = sizeof(Vertex);
+    header.vertexCount = (uint32_t)mesh.vertices.size();
+    header.indexType = mesh.shortIndices() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    header.indexCount = (uint32_t)(mesh.shortIndices() ? mesh.indices16.size() : mesh.indices32.size());
+    header.vertexBytesOffset = alignUp(sizeof(MeshCacheHeader));
+    header.indexBytesOffset = alignUp(header.vertexBytesOffset + (uint64_t)header.vertexCount * sizeof(Vertex));
+    for (int i = 0; i < 3; i++) {
+        header.boundsCenter[i] = bounds.center[i];
+        header.boundsHalfExtent[i] = bounds.halfExtent[i];
+    }
+    header.triangleCount = mesh.triangleCount;
+
+    void const *indices = mesh.shortIndices() ? (void const *)mesh.indices16.data() : (void const *)mesh.indices32.data();
+    return writeCacheFile(path, header, mesh.vertices.data(), indices);
+}
+
+// hit: just the mapping, the OBJ isn't even read unless its size or mtime changed.
+// miss: parse the OBJ, write the cache and map what was written
+static bool loadMesh(MeshCacheFile &cache, std::string const &sourcePath) {
+    MeshCacheSource source;
+    std::error_code sizeError, timeError;
+    source.size = std::filesystem::file_size(sourcePath, sizeError);
+    source.mtime = (int64_t)std::filesystem::last_write_time(sourcePath, timeError).time_since_epoch().count();
+    if (sizeError || timeError) {
+        throw std::runtime_error("failed to open " + sourcePath);
+    }
+
+    std::string cachePath = sourcePath + MESH_CACHE_EXTENSION;
+    bool cached = openMeshCache(cache, cachePath);
+    if (cached && cache.header->sourceSize == source.size && cache.header->sourceMtime == source.mtime) {
+        return true;
+    }
+
+    MappedFile file;
+    if (!file.open(sourcePath.c_str())) {
+        throw std::runtime_error("failed to open " + sourcePath);
+    }
+    source.hash = hashBytes(file.data, file.size);
+    file.close();
+    if (cached && cache.header->sourceHash == source.hash) {
+        // touched but not changed: restamp so the next load skips the hash. the mapping stays valid, the rename makes a new
+        // file (windows won't replace a mapped file, there the rename fails and the next load hashes again)
+        MeshCacheHeader header = *cache.header;
+        header.sourceSize = source.size;
+        header.sourceMtime = source.mtime;
+        writeCacheFile(cachePath, header, cache.vertices(), cache.indices());
+        return true;
+    }
+    cache.close();
+
+    ObjMesh mesh;
+    mesh.path = sourcePath;
+    loadObjFile(mesh);
+    if (!writeMeshCache(cachePath, mesh, source) || !openMeshCache(cache, cachePath)) {
+        throw std::runtime_error("failed to cache " + sourcePath + " in " + cachePath);
+    }
+    return false;
+}
+
+std::vector<MeshCacheFile> loadMeshes(ThreadPool &threads, std::vector<std::string> const &paths, ObjLoadStats *stats) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<MeshCacheFile> caches(paths.size());
+    std::vector<std::string> errors(paths.size());
+    std::vector<char> hits(paths.size(), 0);
+
+    // exceptions can't cross parallelFor, same as loadObjFiles
+    threads.parallelFor((uint32_t)paths.size(), [&](uint32_t i) {
+        try {
+            hits[i] = loadMesh(caches[i], paths[i]);
+        } catch (std::exception const &e) {
+            errors[i] = e.what();
+        }
+    });
+    for (auto const &error : errors) {
+        if (!error.empty()) {
+            for (auto &cache : caches) {
+                cache.close();
+            }
+            throw std::runtime_error(error);
+        }
+    }
+
+    ObjLoadStats loaded;
+    loaded.files = (uint32_t)paths.size();
+    loaded.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    for (size_t i = 0; i < caches.size(); i++) {
+        loaded.triangles += caches[i].header->triangleCount;
+        loaded.cacheHits += hits[i];
+    }
+    std::cout << "loaded " << loaded.files << " meshes (" << loaded.cacheHits << " from " << MESH_CACHE_EXTENSION << "), " << loaded.triangles << " triangles in " << loaded.ms << " ms (" << loaded.msPerMillionTriangles() << " ms per million triangles)\n";
+    if (stats) {
+        *stats = loaded;
+    }
+    return caches;
+}
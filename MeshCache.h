@@ -0,0 +1,86 @@
+#pragma once
+#include "Vulkan.h"
+#include "VertexFormat.h"
+
+#include <string>
+#include <vector>
+
+struct ThreadPool;
+struct ObjMesh;
+struct ObjLoadStats;
+
+#define MESH_CACHE_MAGIC 0x434d4b56 // "VKMC"
+#define MESH_CACHE_VERSION 3 // 2: optimizeMesh'd index and vertex order, 3: source size and mtime
+#define MESH_CACHE_ALIGNMENT 64
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+// read only view of a whole file, mmap'd (MapViewOfFile on windows)
+struct MappedFile {
+    void const *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+
+    bool open(char const *path); // false if it doesn't exist or can't be mapped
+    void close();
+};
+
+// 64 bit hash of a byte range, 8 bytes per step. used to tie a cache to its source file
+uint64_t hashBytes(void const *data, size_t size);
+
+// what a cache remembers of its source. size and mtime are compared first, the
+// file is only read and hashed when they changed (a touched but identical file still hits)
+struct MeshCacheSource {
+    uint64_t size = 0;
+    int64_t mtime = 0; // std::filesystem::last_write_time ticks
+    uint64_t hash = 0;
+};
+
+// File layout: [header][vertices][indices], each blob MESH_CACHE_ALIGNMENT aligned.
+// The blobs are exactly what MeshArena uploads (Vertex, then 16 or 32 bit indices),
+// so a mapped cache is copied into the staging ring and nowhere else.
+struct alignas(MESH_CACHE_ALIGNMENT) MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;   // hashBytes of the source file when the cache was written
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint32_t vertexStride; // sizeof(Vertex) when written, a changed Vertex invalidates the cache too
+    uint32_t vertexCount;
+    uint32_t indexType;    // VkIndexType
+    uint32_t indexCount;
+    uint64_t vertexBytesOffset; // from the start of the file
+    uint64_t indexBytesOffset;
+    float boundsCenter[3];
+    float boundsHalfExtent[3];
+    uint32_t triangleCount;
+};
+
+// a validated, mapped cache file. close() once its models are created, the uploads have their own copy by then
+struct MeshCacheFile {
+    std::string path;
+    MappedFile file;
+    MeshCacheHeader const *header = nullptr;
+
+    Vertex const *vertices() const {
+        return (Vertex const *)((char const *)file.data + header->vertexBytesOffset);
+    }
+    void const *indices() const {
+        return (char const *)file.data + header->indexBytesOffset;
+    }
+    MeshBounds bounds() const;
+    void close();
+};
+
+// false, with nothing left open, if path is missing, truncated or from another version. whose source it is is up to the caller
+bool openMeshCache(MeshCacheFile &cache, std::string const &path);
+
+// writes through writeFileAtomic, like savePipelineCache. logs and returns false on failure
+bool writeMeshCache(std::string const &path, ObjMesh const &mesh, MeshCacheSource const &source);
+
+// Mapped caches for OBJ files, one file per ThreadPool job. Each OBJ's <path>.meshcache is
+// used when it was built from the same source (see MeshCacheSource), otherwise the OBJ
+// is parsed and the cache (re)written. Throws if any file fails, after all of them have been tried.
+std::vector<MeshCacheFile> loadMeshes(ThreadPool &threads, std::vector<std::string> const &paths, ObjLoadStats *stats = nullptr);
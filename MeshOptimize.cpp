@@ -0,0 +1,257 @@
+#include "MeshOptimize.h"
+
+#include <algorithm>
+#include <numeric>
+
+// FIFO cache simulation: a vertex is a hit if it was (re)loaded in the last cacheSize misses
+struct FifoCache {
+    std::vector<uint32_t> loadedAt; // miss count when the vertex was loaded, ~0u if never
+    uint32_t cacheSize;
+    uint32_t misses = 0;
+
+    FifoCache(uint32_t vertexCount, uint32_t cacheSize) : loadedAt(vertexCount, ~0u), cacheSize(cacheSize) {}
+
+    void reset() {
+        std::fill(loadedAt.begin(), loadedAt.end(), ~0u);
+        misses = 0;
+    }
+
+    void access(uint32_t v) {
+        if (loadedAt[v] == ~0u || misses - loadedAt[v] >= cacheSize) {
+            loadedAt[v] = misses++;
+        }
+    }
+};
+
+VertexCacheStats analyzeVertexCache(std::vector<uint32_t> const &indices, uint32_t vertexCount, uint32_t cacheSize) {
+    VertexCacheStats stats;
+    if (indices.size() < 3) {
+        return stats; // no triangles, and 0/0 would report NaN
+    }
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t uniqueVertices = 0;
+    for (uint32_t v : indices) {
+        cache.access(v);
+        if (!referenced[v]) {
+            referenced[v] = true;
+            uniqueVertices++;
+        }
+    }
+    stats.acmr = (float)cache.misses / (float)(indices.size() / 3);
+    stats.atvr = (float)cache.misses / (float)uniqueVertices;
+    return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t> const &indices, uint32_t vertexCount, uint32_t cacheSize, std::vector<uint32_t> *hardBoundaries) {
+    uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+    if (triangleCount == 0) {
+        return {}; // the fan loop below starts from vertex 0, which may not exist
+    }
+
+    // vertex -> triangles adjacency, CSR style
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t v : indices) {
+        adjacencyOffsets[v + 1]++;
+    }
+    std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            adjacency[fill[indices[3 * t + c]]++] = t;
+        }
+    }
+
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd; // recently used vertices, the cheapest places to restart
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0; // next vertex to try once the dead end stack is exhausted
+    int64_t fanning = 0;
+    bool restarted = true; // the first fan starts cold too
+    while (fanning >= 0) {
+        uint32_t emittedTriangles = (uint32_t)(result.size() / 3);
+        if (restarted && hardBoundaries && (hardBoundaries->empty() || hardBoundaries->back() != emittedTriangles)) {
+            hardBoundaries->push_back(emittedTriangles);
+        }
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (uint32_t c = 0; c < 3; c++) {
+                uint32_t v = indices[3 * t + c];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // prefer the candidate that stays in cache longest while still having triangles to emit
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+
+        restarted = best < 0;
+        if (restarted) {
+            while (!deadEnd.empty() && best < 0) {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0) {
+                    best = v;
+                }
+            }
+            while (cursor < vertexCount && best < 0) {
+                if (liveTriangles[cursor] > 0) {
+                    best = cursor;
+                }
+                cursor++;
+            }
+        }
+        fanning = best;
+    }
+    if (hardBoundaries && !hardBoundaries->empty() && hardBoundaries->back() == triangleCount) {
+        hardBoundaries->pop_back(); // the final "restart" found nothing left
+    }
+    return result;
+}
+
+uint32_t optimizeOverdraw(std::vector<uint32_t> &indices, std::vector<Vertex> const &vertices, std::vector<uint32_t> const &hardBoundaries, uint32_t cacheSize, float threshold) {
+    uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+    if (triangleCount == 0) {
+        return 0;
+    }
+    float meshAcmr = analyzeVertexCache(indices, (uint32_t)vertices.size(), cacheSize).acmr;
+
+    // keep a hard boundary as a cluster split if the cluster before it, simulated from a
+    // cold cache, is already close to the whole mesh's ACMR: splitting there is nearly free
+    std::vector<uint32_t> clusterStarts = {0};
+    FifoCache cache((uint32_t)vertices.size(), cacheSize);
+    uint32_t next = 0;
+    for (size_t b = 0; b <= hardBoundaries.size(); b++) {
+        uint32_t end = b < hardBoundaries.size() ? hardBoundaries[b] : triangleCount;
+        for (; next < end; next++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                cache.access(indices[3 * next + c]);
+            }
+        }
+        uint32_t clusterTriangles = end - clusterStarts.back();
+        if (end < triangleCount && clusterTriangles > 0 && (float)cache.misses / clusterTriangles <= threshold * meshAcmr) {
+            clusterStarts.push_back(end);
+            cache.reset();
+        }
+    }
+    uint32_t clusterCount = (uint32_t)clusterStarts.size();
+    clusterStarts.push_back(triangleCount);
+
+    // area weighted centroid and summed normal per cluster
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+    for (uint32_t c = 0; c < clusterCount; c++) {
+        float clusterArea = 0.0f;
+        for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            glm::vec3 p0 = vertices[indices[3 * t]].pos, p1 = vertices[indices[3 * t + 1]].pos, p2 = vertices[indices[3 * t + 2]].pos;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+            centroids[c] += center * area;
+            normals[c] += n;
+            clusterArea += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += clusterArea;
+        centroids[c] = clusterArea > 0.0f ? centroids[c] / clusterArea : centroids[c];
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : meshCentroid;
+
+    // clusters facing away from the middle of the mesh tend to be in front, draw them first
+    std::vector<float> sortKeys(clusterCount);
+    for (uint32_t c = 0; c < clusterCount; c++) {
+        float normalLength = glm::length(normals[c]);
+        sortKeys[c] = normalLength > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / normalLength) : 0.0f;
+    }
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (uint32_t c : order) {
+        sorted.insert(sorted.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+    }
+    indices = std::move(sorted);
+    return clusterCount;
+}
+
+uint32_t optimizeVertexFetchRemap(std::vector<uint32_t> &indices, uint32_t vertexCount, std::vector<uint32_t> &remap) {
+    remap.assign(vertexCount, ~0u);
+    uint32_t next = 0;
+    for (uint32_t &v : indices) {
+        if (remap[v] == ~0u) {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+    return next;
+}
+
+bool narrowIndices(std::vector<uint32_t> const &indices, std::vector<uint16_t> &narrowed) {
+    for (uint32_t v : indices) {
+        if (v > UINT16_MAX) {
+            return false;
+        }
+    }
+    narrowed.assign(indices.begin(), indices.end());
+    return true;
+}
+
+MeshOptimizeReport optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, std::vector<glm::vec3> *normals, uint32_t cacheSize) {
+    MeshOptimizeReport report;
+    if (indices.empty()) {
+        return report; // an obj without faces, nothing to reorder
+    }
+    uint32_t vertexCount = (uint32_t)vertices.size();
+    report.before = analyzeVertexCache(indices, vertexCount, cacheSize);
+
+    std::vector<uint32_t> hardBoundaries;
+    indices = optimizeVertexCache(indices, vertexCount, cacheSize, &hardBoundaries);
+    report.clusters = optimizeOverdraw(indices, vertices, hardBoundaries, cacheSize);
+
+    std::vector<uint32_t> remap;
+    uint32_t newCount = optimizeVertexFetchRemap(indices, vertexCount, remap);
+    remapVertices(vertices, remap, newCount);
+    if (normals && !normals->empty()) {
+        remapVertices(*normals, remap, newCount);
+    }
+
+    report.after = analyzeVertexCache(indices, newCount, cacheSize);
+    return report;
+}
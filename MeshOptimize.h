@@ -0,0 +1,55 @@
+#pragma once
+#include "Vulkan.h"
+
+#include <vector>
+
+// FIFO post-transform cache size the optimizer targets and the stats simulate. Real
+// hardware varies (and isn't strictly FIFO any more), 16 is a safe middle ground.
+#define DEFAULT_VERTEX_CACHE_SIZE 16
+
+// ACMR: vertex shader invocations per triangle, 0.5 is the floor for a regular grid, 3 the worst case.
+// ATVR: invocations per referenced vertex, 1.0 means every vertex is shaded exactly once.
+struct VertexCacheStats {
+    float acmr = 0;
+    float atvr = 0;
+};
+
+VertexCacheStats analyzeVertexCache(std::vector<uint32_t> const &indices, uint32_t vertexCount, uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Tipsify (Sander, Nehab, Barczak 2007): fans around recently used vertices to keep the
+// cache warm. hardBoundaries, if given, gets the output triangle at which each cache
+// discontinuity starts, optimizeOverdraw uses them as cluster candidates.
+std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t> const &indices, uint32_t vertexCount, uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE, std::vector<uint32_t> *hardBoundaries = nullptr);
+
+// Splits the cache optimized order into clusters wherever that costs less than threshold
+// times the mesh's ACMR, then draws the outward facing clusters first so they occlude the
+// rest. Returns the number of clusters.
+uint32_t optimizeOverdraw(std::vector<uint32_t> &indices, std::vector<Vertex> const &vertices, std::vector<uint32_t> const &hardBoundaries, uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE, float threshold = 1.05f);
+
+// new vertex order = first use in indices, indices are rewritten and unreferenced vertices dropped.
+// returns the new vertex count, remap[old] is the new index (~0u for dropped ones)
+uint32_t optimizeVertexFetchRemap(std::vector<uint32_t> &indices, uint32_t vertexCount, std::vector<uint32_t> &remap);
+
+template <typename T>
+void remapVertices(std::vector<T> &vertices, std::vector<uint32_t> const &remap, uint32_t newCount) {
+    std::vector<T> remapped(newCount);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        if (remap[i] != ~0u) {
+            remapped[remap[i]] = vertices[i];
+        }
+    }
+    vertices = std::move(remapped);
+}
+
+// false (and narrowed untouched) if some index doesn't fit in 16 bits
+bool narrowIndices(std::vector<uint32_t> const &indices, std::vector<uint16_t> &narrowed);
+
+struct MeshOptimizeReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t clusters = 0;
+};
+
+// The whole pass, run once on load (the mesh cache stores the result): vertex cache order,
+// overdraw cluster order, then vertex fetch order. normals, if given, are reordered with vertices.
+MeshOptimizeReport optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, std::vector<glm::vec3> *normals = nullptr, uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
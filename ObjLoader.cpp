@@ -0,0 +1,136 @@
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+#include "MeshOptimize.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+void VertexDedupTable::init(size_t maxEntries) {
+    size_t capacity = 16;
+    while (capacity < maxEntries * 2) {
+        capacity <<= 1;
+    }
+    keys.assign(capacity, EMPTY);
+    values.resize(capacity);
+    mask = capacity - 1;
+}
+
+// splitmix64's finalizer, consecutive indices would otherwise cluster in neighbouring slots
+static uint64_t hashKey(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+uint32_t VertexDedupTable::findOrInsert(uint64_t key, uint32_t newValue, bool &inserted) {
+    for (uint64_t slot = hashKey(key) & mask;; slot = (slot + 1) & mask) {
+        if (keys[slot] == key) {
+            inserted = false;
+            return values[slot];
+        }
+        if (keys[slot] == EMPTY) {
+            keys[slot] = key;
+            values[slot] = newValue;
+            inserted = true;
+            return newValue;
+        }
+    }
+}
+
+void loadObjFile(ObjMesh &mesh) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, mesh.path.c_str())) {
+        throw std::runtime_error("failed to load " + mesh.path + ": " + warn + err);
+    }
+
+    size_t cornerCount = 0;
+    for (auto const &shape : shapes) {
+        cornerCount += shape.mesh.indices.size();
+    }
+    bool hasColors = attrib.colors.size() == attrib.vertices.size();
+    bool hasNormals = !attrib.normals.empty();
+
+    // texcoords aren't part of Vertex yet, so corners that only differ in them share a vertex
+    VertexDedupTable dedup;
+    dedup.init(cornerCount);
+    std::vector<uint32_t> indices;
+    indices.reserve(cornerCount);
+    for (auto const &shape : shapes) {
+        for (auto const &index : shape.mesh.indices) {
+            uint64_t key = ((uint64_t)(uint32_t)index.vertex_index << 32) | (uint32_t)(index.normal_index + 1);
+            bool inserted;
+            uint32_t vertexIndex = dedup.findOrInsert(key, (uint32_t)mesh.vertices.size(), inserted);
+            if (inserted) {
+                size_t p = 3 * (size_t)index.vertex_index;
+                Vertex vertex{{attrib.vertices[p], attrib.vertices[p + 1], attrib.vertices[p + 2]}, {1.0f, 1.0f, 1.0f}};
+                if (hasColors) {
+                    vertex.color = {attrib.colors[p], attrib.colors[p + 1], attrib.colors[p + 2]};
+                }
+                mesh.vertices.push_back(vertex);
+                if (hasNormals) {
+                    size_t n = 3 * (size_t)index.normal_index;
+                    mesh.normals.push_back(index.normal_index >= 0 ? glm::vec3(attrib.normals[n], attrib.normals[n + 1], attrib.normals[n + 2]) : glm::vec3(0.0f, 0.0f, 1.0f));
+                }
+            }
+            indices.push_back(vertexIndex);
+        }
+    }
+
+    mesh.optimization = optimizeMesh(mesh.vertices, indices, &mesh.normals);
+    if (!narrowIndices(indices, mesh.indices16)) {
+        mesh.indices32 = std::move(indices);
+    }
+    mesh.triangleCount = (uint32_t)(cornerCount / 3);
+    mesh.loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // one write so lines from parallel loads don't interleave
+    char line[512];
+    snprintf(line, sizeof(line), "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u clusters\n", mesh.path.c_str(), mesh.optimization.before.acmr, mesh.optimization.after.acmr,
+             mesh.optimization.before.atvr, mesh.optimization.after.atvr, mesh.optimization.clusters);
+    std::cout << line;
+}
+
+std::vector<ObjMesh> loadObjFiles(ThreadPool &threads, std::vector<std::string> const &paths, ObjLoadStats *stats) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<ObjMesh> meshes(paths.size());
+    std::vector<std::string> errors(paths.size());
+
+    // exceptions can't cross parallelFor, each job keeps its own and the first is rethrown below
+    threads.parallelFor((uint32_t)paths.size(), [&](uint32_t i) {
+        meshes[i].path = paths[i];
+        try {
+            loadObjFile(meshes[i]);
+        } catch (std::exception const &e) {
+            errors[i] = e.what();
+        }
+    });
+    for (auto const &error : errors) {
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+
+    ObjLoadStats loaded;
+    loaded.files = (uint32_t)paths.size();
+    loaded.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    for (auto const &mesh : meshes) {
+        loaded.triangles += mesh.triangleCount;
+    }
+    std::cout << "loaded " << loaded.files << " obj files, " << loaded.triangles << " triangles in " << loaded.ms << " ms (" << loaded.msPerMillionTriangles() << " ms per million triangles)\n";
+    if (stats) {
+        *stats = loaded;
+    }
+    return meshes;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "Vulkan.h"
+#include "MeshOptimize.h"
+
+#include <string>
+#include <vector>
+
+struct ThreadPool;
+
+// one OBJ file flattened into a single indexed mesh, see createModel(arena, uploads, ObjMesh)
+struct ObjMesh {
+    std::string path;
+    std::vector<Vertex> vertices;       // vertex colors if the file has them, white otherwise
+    std::vector<glm::vec3> normals;     // per vertex, empty if the file has none. for encodeVertices
+    std::vector<uint16_t> indices16;    // fewer than 65536 vertices
+    std::vector<uint32_t> indices32;    // otherwise
+    uint32_t triangleCount = 0;
+    MeshOptimizeReport optimization;    // vertex cache stats before and after optimizeMesh
+    double loadMs = 0;                  // parse + dedup + optimize
+
+    bool shortIndices() const {
+        return indices32.empty();
+    }
+};
+
+// Open addressing map from an OBJ (position, normal) index pair to the vertex emitted for it.
+// Linear probing over flat arrays sized up front for the mesh's corner count, so lookups
+// touch one or two cache lines and never allocate, unlike std::unordered_map's node per entry.
+struct VertexDedupTable {
+    static constexpr uint64_t EMPTY = ~0ull;
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> values;
+    uint64_t mask = 0;
+
+    // sized so the table stays at most half full with maxEntries in it
+    void init(size_t maxEntries);
+
+    // the value stored for key, or newValue after inserting it (inserted is set then)
+    uint32_t findOrInsert(uint64_t key, uint32_t newValue, bool &inserted);
+};
+
+struct ObjLoadStats {
+    uint32_t files = 0;
+    uint32_t cacheHits = 0; // see loadMeshes
+    uint64_t triangles = 0;
+    double ms = 0; // wall clock for the whole batch
+
+    double msPerMillionTriangles() const {
+        return triangles ? ms * 1e6 / (double)triangles : 0.0;
+    }
+};
+
+// parses, dedupes and optimizes (see optimizeMesh) mesh.path into mesh, throws if the file can't be loaded
+void loadObjFile(ObjMesh &mesh);
+
+// Parses, dedupes and optimizes the files on the pool's threads (plus the caller), one file per job.
+// Throws if any file fails to load, after all of them have been tried.
+std::vector<ObjMesh> loadObjFiles(ThreadPool &threads, std::vector<std::string> const &paths, ObjLoadStats *stats = nullptr);
@@ -0,0 +1,67 @@
+#include "PipelineCache.h"
+#include "FileIO.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// the driver rejects mismatched data itself on most implementations, but not all of them do it
+// gracefully, so only hand it data we know came from the same device and driver
+static bool isCompatible(VkPhysicalDevice physicalDevice, std::vector<char> const &data) {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    return header.headerSize >= sizeof(header) && header.headerSize <= data.size()
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties.vendorID
+        && header.deviceID == properties.deviceID
+        && memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void loadPipelineCache(VkHandles &vk, char const *path) {
+    auto start = std::chrono::high_resolution_clock::now();
+    vk.pipelineCachePath = path;
+
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        data.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        if (!file) {
+            data.clear();
+        }
+    }
+
+    vk.pipelineCacheHit = isCompatible(vk.physicalDevice, data);
+    if (!data.empty() && !vk.pipelineCacheHit) {
+        std::cout << "pipeline cache " << path << " is from another device or driver, starting empty\n";
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = vk.pipelineCacheHit ? data.size() : 0;
+    createInfo.pInitialData = vk.pipelineCacheHit ? data.data() : nullptr;
+    VK_CHECK(vkCreatePipelineCache(vk.device, &createInfo, nullptr, &vk.pipelineCache));
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "pipeline cache " << (vk.pipelineCacheHit ? "hit" : "miss") << ": loaded " << createInfo.initialDataSize << " bytes in " << elapsed.count() << " ms\n";
+}
+
+void savePipelineCache(VkHandles &vk) {
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(vk.device, vk.pipelineCache, &size, nullptr));
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(vk.device, vk.pipelineCache, &size, data.data()));
+
+    writeFileAtomic(vk.pipelineCachePath, "pipeline cache", [&](std::ostream &file) {
+        file.write(data.data(), size);
+    });
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "Vulkan.h"
+
+#define DEFAULT_PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
+// Creates vk.pipelineCache, seeded from the file at path when that was written by this
+// device and driver (the header's vendorID/deviceID/pipelineCacheUUID all match). Anything
+// else, including a missing or truncated file, starts an empty cache. Sets vk.pipelineCacheHit.
+void loadPipelineCache(VkHandles &vk, char const *path);
+
+// Writes the cache back at shutdown through writeFileAtomic: a temp file renamed over
+// path, so a crash mid-write never leaves a torn cache for the next launch.
+void savePipelineCache(VkHandles &vk);
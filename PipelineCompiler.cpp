@@ -0,0 +1,77 @@
+#include "PipelineCompiler.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+
+void VkPipelineCompiler::init(Vulkan &vulkan, ThreadPool &threads) {
+    this->vulkan = &vulkan;
+    this->threads = &threads;
+    compiling = 0;
+    stats = PipelineCompileStats{};
+}
+
+void VkPipelineCompiler::destroy() {
+    waitIdle();
+    for (auto &p : pipelines) {
+        if (p.pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(vulkan->handles.device, p.pipeline, nullptr);
+        }
+    }
+    pipelines.clear();
+}
+
+VkPendingPipeline *VkPipelineCompiler::request(VkPipelineLayout layout, char const *vertexShader, char const *fragmentShader) {
+    VkPendingPipeline *pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.requested++;
+        for (auto &p : pipelines) {
+            if (p.layout == layout && p.vertexShader == vertexShader && p.fragmentShader == fragmentShader) {
+                stats.deduplicated++;
+                return &p;
+            }
+        }
+        pending = &pipelines.emplace_back();
+        pending->layout = layout;
+        pending->vertexShader = vertexShader;
+        pending->fragmentShader = fragmentShader;
+        compiling++;
+    }
+
+    threads->submit([this, pending] {
+        auto start = std::chrono::high_resolution_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        try {
+            pipeline = createPipelineWithLayout(*vulkan, pending->layout, pending->vertexShader.c_str(), pending->fragmentShader.c_str());
+        } catch (std::exception const &e) {
+            std::cout << "failed to compile pipeline " << pending->vertexShader << " + " << pending->fragmentShader << ": " << e.what() << "\n";
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        pending->pipeline = pipeline;
+        pending->compileMs = elapsed.count();
+        pending->state.store(pipeline != VK_NULL_HANDLE ? VkPendingPipeline::Ready : VkPendingPipeline::Failed, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pipeline != VK_NULL_HANDLE) {
+            stats.compiled++;
+            stats.compileMs.add(elapsed.count());
+        } else {
+            stats.failed++;
+        }
+        compiling--;
+        if (compiling == 0) {
+            compileFinished.notify_all();
+        }
+    });
+    return pending;
+}
+
+void VkPipelineCompiler::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    compileFinished.wait(lock, [this] { return compiling == 0; });
+}
+
+bool VkPipelineCompiler::idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return compiling == 0;
+}
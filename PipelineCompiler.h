@@ -0,0 +1,66 @@
+#pragma once
+#include "Vulkan.h"
+#include "Profiler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+struct ThreadPool;
+
+// A pipeline some worker is (or was) compiling. Owned by the VkPipelineCompiler that handed
+// it out and stays valid until that is destroyed. get() is safe to call from any thread.
+struct VkPendingPipeline {
+    enum State : uint32_t { Compiling, Ready, Failed };
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    std::string vertexShader;
+    std::string fragmentShader;
+    std::atomic<uint32_t> state{Compiling};
+    VkPipeline pipeline = VK_NULL_HANDLE; // written before state becomes Ready
+    double compileMs = 0;
+
+    bool ready() const {
+        return state.load(std::memory_order_acquire) == Ready;
+    }
+    // VK_NULL_HANDLE until ready: skip the draws or fall back to a pipeline that is
+    VkPipeline get() const {
+        return ready() ? pipeline : VK_NULL_HANDLE;
+    }
+};
+
+struct PipelineCompileStats {
+    uint32_t requested = 0;
+    uint32_t deduplicated = 0; // requests that matched one already made
+    uint32_t compiled = 0;
+    uint32_t failed = 0;
+    RollingStats compileMs; // per pipeline, on a worker
+};
+
+// Builds graphics pipelines on the thread pool so new materials don't hitch the frame
+// loop. Same render pass, fixed function state and vertex layout as createPipelineWithLayout
+// (which the workers call), the caller picks the layout and shaders. Workers share
+// vk.pipelineCache, which Vulkan synchronizes internally, and vk.shaderModules, so
+// each SPIR-V file is read and turned into a module once however many pipelines use it.
+// request() returns right away; asking twice for the same layout and shaders returns the
+// same VkPendingPipeline. Nothing here is per frame: a pipeline that becomes ready is
+// simply picked up by the next recording that asks for it.
+struct VkPipelineCompiler {
+    Vulkan *vulkan = nullptr;
+    ThreadPool *threads = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable compileFinished;
+    std::deque<VkPendingPipeline> pipelines; // deque: handed out pointers stay put as it grows
+    uint32_t compiling = 0;
+    PipelineCompileStats stats;
+
+    void init(Vulkan &vulkan, ThreadPool &threads);
+    void destroy(); // waits for the workers, then destroys every pipeline. the device must be idle
+
+    VkPendingPipeline *request(VkPipelineLayout layout, char const *vertexShader, char const *fragmentShader);
+    void waitIdle(); // blocks until every request so far has finished, e.g. behind a loading screen
+    bool idle();
+};
@@ -0,0 +1,194 @@
+#include "Profiler.h"
+
+#include <algorithm>
+
+#define PIPELINE_STATISTICS_FLAGS (VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT \
+    | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT \
+    | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+void RollingStats::add(double value) {
+    if (samples.size() < window) {
+        samples.push_back(value);
+    } else {
+        samples[next] = value;
+    }
+    next = (next + 1) % window;
+}
+
+RollingStats::Summary RollingStats::summary() const {
+    Summary s;
+    s.samples = (uint32_t)samples.size();
+    if (samples.empty()) {
+        return s;
+    }
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (double v : sorted) {
+        sum += v;
+    }
+    s.min = sorted.front();
+    s.avg = sum / sorted.size();
+    s.p50 = sorted[sorted.size() / 2];
+    s.p99 = sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * 0.99))];
+    return s;
+}
+
+void VkGpuProfiler::init(VkHandles &vk, bool pipelineStatistics, uint32_t maxSections) {
+    this->vk = &vk;
+    this->maxSections = maxSections;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vk.physicalDevice, &properties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vk.physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vk.physicalDevice, &familyCount, families.data());
+    uint32_t validBits = families[vk.graphicsFamily].timestampValidBits;
+    timestamps = properties.limits.timestampComputeAndGraphics && validBits > 0;
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    timestampPeriodMs = properties.limits.timestampPeriod / 1e6;
+    statistics = pipelineStatistics && vk.pipelineStatisticsQuery;
+
+    for (auto &f : frames) {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        if (timestamps) {
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = maxSections * 2;
+            VK_CHECK(vkCreateQueryPool(vk.device, &poolInfo, nullptr, &f.timestampPool));
+        }
+        if (statistics) {
+            poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            poolInfo.queryCount = 1;
+            poolInfo.pipelineStatistics = PIPELINE_STATISTICS_FLAGS;
+            VK_CHECK(vkCreateQueryPool(vk.device, &poolInfo, nullptr, &f.statisticsPool));
+        }
+    }
+}
+
+void VkGpuProfiler::destroy() {
+    for (auto &f : frames) {
+        if (f.timestampPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(vk->device, f.timestampPool, nullptr);
+        }
+        if (f.statisticsPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(vk->device, f.statisticsPool, nullptr);
+        }
+    }
+}
+
+void VkGpuProfiler::collect(uint32_t frameIdx) {
+    Frame &f = frames[frameIdx];
+    if (!f.recorded) {
+        return;
+    }
+    f.recorded = false;
+
+    // no WAIT_BIT: the frame's fence has signaled so the results are there, if a query
+    // somehow isn't we get VK_NOT_READY and skip the frame instead of stalling
+    if (timestamps && !f.sections.empty()) {
+        std::vector<uint64_t> ticks(f.sections.size() * 2);
+        VkResult result = vkGetQueryPoolResults(vk->device, f.timestampPool, 0, (uint32_t)ticks.size(), ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            // only differences are meaningful once the counter can wrap, so the frame's extent is
+            // measured from its first section's begin rather than with min/max over raw ticks
+            uint64_t frameBegin = ticks[0] & timestampMask, frameLength = 0;
+            for (size_t i = 0; i < f.sections.size(); i++) {
+                sectionTimes[f.sections[i]].add(elapsedTicks(ticks[i * 2], ticks[i * 2 + 1]) * timestampPeriodMs);
+                frameLength = std::max(frameLength, elapsedTicks(frameBegin, ticks[i * 2 + 1]));
+            }
+            uint64_t frameEnd = (frameBegin + frameLength) & timestampMask;
+            // frames have to be collected in submission order for the gap to mean anything, see the drains in main/bench.
+            // a gap past half the counter range is an overlap with the previous frame, not an idle stretch
+            uint64_t gap = elapsedTicks(lastFrameEndTicks, frameBegin);
+            if (lastFrameEndTicks != 0 && gap <= timestampMask / 2) {
+                gpuIdleMs.add(gap * timestampPeriodMs);
+            }
+            if (lastFrameEndTicks == 0 || elapsedTicks(lastFrameEndTicks, frameEnd) <= timestampMask / 2) {
+                lastFrameEndTicks = frameEnd;
+            }
+        }
+    }
+    if (f.statisticsWritten) {
+        PipelineStatistics stats;
+        VkResult result = vkGetQueryPoolResults(vk->device, f.statisticsPool, 0, 1, sizeof(stats), &stats, sizeof(stats), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            lastStatistics = stats;
+            uint64_t const *counters = (uint64_t const *)&stats;
+            for (size_t i = 0; i < statisticsHistory.size(); i++) {
+                statisticsHistory[i].add((double)counters[i]);
+            }
+        }
+    }
+}
+
+void VkGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIdx) {
+    frame = frameIdx;
+    Frame &f = frames[frameIdx];
+    f.sections.clear();
+    f.statisticsWritten = false;
+    f.recorded = true;
+    if (timestamps) {
+        vkCmdResetQueryPool(commandBuffer, f.timestampPool, 0, maxSections * 2);
+    }
+    if (statistics) {
+        vkCmdResetQueryPool(commandBuffer, f.statisticsPool, 0, 1);
+    }
+}
+
+uint32_t VkGpuProfiler::beginSection(VkCommandBuffer commandBuffer, char const *name) {
+    Frame &f = frames[frame];
+    if (!timestamps || f.sections.size() == maxSections) {
+        return UINT32_MAX;
+    }
+
+    auto it = sectionIds.find(name);
+    uint32_t id;
+    if (it == sectionIds.end()) {
+        id = (uint32_t)sectionNames.size();
+        sectionIds[name] = id;
+        sectionNames.push_back(name);
+        sectionTimes.emplace_back();
+    } else {
+        id = it->second;
+    }
+
+    uint32_t slot = (uint32_t)f.sections.size();
+    f.sections.push_back(id);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, f.timestampPool, slot * 2);
+    return slot;
+}
+
+void VkGpuProfiler::endSection(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if (slot == UINT32_MAX) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames[frame].timestampPool, slot * 2 + 1);
+}
+
+void VkGpuProfiler::beginStatistics(VkCommandBuffer commandBuffer) {
+    if (statistics) {
+        vkCmdBeginQuery(commandBuffer, frames[frame].statisticsPool, 0, 0);
+    }
+}
+
+void VkGpuProfiler::endStatistics(VkCommandBuffer commandBuffer) {
+    if (statistics) {
+        vkCmdEndQuery(commandBuffer, frames[frame].statisticsPool, 0);
+        frames[frame].statisticsWritten = true;
+    }
+}
+
+std::vector<VkGpuProfiler::SectionReport> VkGpuProfiler::report() const {
+    std::vector<SectionReport> sections;
+    for (size_t i = 0; i < sectionNames.size(); i++) {
+        sections.push_back({sectionNames[i], sectionTimes[i].summary()});
+    }
+    return sections;
+}
+
+RollingStats::Summary VkGpuProfiler::section(char const *name) const {
+    auto it = sectionIds.find(name);
+    return it == sectionIds.end() ? RollingStats::Summary{} : sectionTimes[it->second].summary();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "Vulkan.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Fixed window of the most recent samples, summarized on demand.
+struct RollingStats {
+    struct Summary {
+        double min = 0, avg = 0, p50 = 0, p99 = 0;
+        uint32_t samples = 0;
+    };
+
+    std::vector<double> samples; // ring buffer once full
+    uint32_t window = 256;
+    uint32_t next = 0;
+
+    void add(double value);
+    Summary summary() const;
+};
+
+// per-draw-pass pipeline counters, in the order the query writes them
+struct PipelineStatistics {
+    uint64_t inputAssemblyVertices;
+    uint64_t inputAssemblyPrimitives;
+    uint64_t vertexShaderInvocations;
+    uint64_t clippingInvocations;
+    uint64_t clippingPrimitives;
+    uint64_t fragmentShaderInvocations;
+};
+
+// GPU timings for named sections of a frame plus optional pipeline statistics, with a
+// query pool per frame in flight. A frame's results are read in collect(), right after
+// its inFlightFence signaled, so reading them back never waits on the gpu.
+//
+// Per frame: collect() once the fence signaled, beginFrame() at the start of the command
+// buffer (outside any render pass, it resets the pools), then any number of
+// beginSection/endSection pairs and at most one beginStatistics/endStatistics pair.
+struct VkGpuProfiler {
+    VkHandles *vk = nullptr;
+    bool timestamps = false; // the graphics queue can write timestamps
+    bool statistics = false; // pipelineStatisticsQuery was requested and is supported
+    double timestampPeriodMs = 0;
+    uint64_t timestampMask = ~0ull; // timestampValidBits of the graphics family, the bits above are garbage
+    uint32_t maxSections = 0;
+
+    struct Frame {
+        VkQueryPool timestampPool = VK_NULL_HANDLE; // [begin, end] per section
+        VkQueryPool statisticsPool = VK_NULL_HANDLE;
+        std::vector<uint32_t> sections; // section id per written pair
+        bool recorded = false;
+        bool statisticsWritten = false;
+    };
+    std::array<Frame, MAX_FRAMES_IN_FLIGHT> frames;
+    uint32_t frame = 0;
+
+    std::vector<std::string> sectionNames;
+    std::unordered_map<std::string, uint32_t> sectionIds;
+    std::vector<RollingStats> sectionTimes; // ms, by section id
+
+    // present profile readout, see VkPresentConfig. cpu wait is fed from Vulkan::cpuWaitMs by drawFrame,
+    // gpu idle is the gap between the last timestamp of one frame and the first of the next
+    RollingStats cpuWaitMs;
+    RollingStats gpuIdleMs;
+    uint64_t lastFrameEndTicks = 0;
+
+    PipelineStatistics lastStatistics{};
+    std::array<RollingStats, sizeof(PipelineStatistics) / sizeof(uint64_t)> statisticsHistory;
+
+    void init(VkHandles &vk, bool pipelineStatistics, uint32_t maxSections = 32);
+    void destroy();
+
+    void collect(uint32_t frameIdx);
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIdx);
+
+    // returns the slot to pass to endSection. sections can nest but not straddle command buffers
+    uint32_t beginSection(VkCommandBuffer commandBuffer, char const *name);
+    void endSection(VkCommandBuffer commandBuffer, uint32_t slot);
+
+    // statistics can't be active while secondary command buffers execute (that needs inheritedQueries)
+    void beginStatistics(VkCommandBuffer commandBuffer);
+    void endStatistics(VkCommandBuffer commandBuffer);
+
+    // for metrics scraping: rolling min/avg/p99 in ms over the last RollingStats::window frames
+    struct SectionReport {
+        std::string name;
+        RollingStats::Summary ms;
+    };
+    std::vector<SectionReport> report() const;
+    RollingStats::Summary section(char const *name) const;
+
+private:
+    // end - begin in ticks, modulo the valid bits so a counter that wrapped in between still works
+    uint64_t elapsedTicks(uint64_t begin, uint64_t end) const {
+        return (end - begin) & timestampMask;
+    }
+};
@@ -0,0 +1,69 @@
+#include "Record.h"
+
+#include <algorithm>
+
+void VkParallelRecorder::init(VkHandles &vk, ThreadPool &threads, uint32_t chunkCount) {
+    this->vk = &vk;
+    this->threads = &threads;
+    this->chunkCount = chunkCount ? chunkCount : threads.size() + 1;
+
+    chunks.resize(this->chunkCount);
+    for (auto &frames : chunks) {
+        for (auto &chunk : frames) {
+            chunk.commandPool = vk.createCommandPool();
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = chunk.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+            VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocInfo, &chunk.commandBuffer));
+        }
+    }
+}
+
+void VkParallelRecorder::destroy() {
+    for (auto &frames : chunks) {
+        for (auto &chunk : frames) {
+            vkDestroyCommandPool(vk->device, chunk.commandPool, nullptr);
+        }
+    }
+    chunks.clear();
+}
+
+void VkParallelRecorder::record(VkCommandBuffer primary, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t frame, uint32_t drawCount,
+                                std::function<void(VkCommandBuffer, uint32_t, uint32_t)> const &recordRange) {
+    // don't spin up more chunks than there are draws
+    uint32_t activeChunks = std::max(1u, std::min(chunkCount, drawCount));
+    uint32_t perChunk = (drawCount + activeChunks - 1) / activeChunks;
+
+    threads->parallelFor(activeChunks, [&](uint32_t i) {
+        Chunk &chunk = chunks[i][frame];
+        // the frame's inFlightFence has signaled, nothing from this pool is still executing
+        VK_CHECK(vkResetCommandPool(vk->device, chunk.commandPool, 0));
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = framebuffer;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        VK_CHECK(vkBeginCommandBuffer(chunk.commandBuffer, &beginInfo));
+
+        uint32_t first = std::min(drawCount, i * perChunk);
+        uint32_t end = std::min(drawCount, first + perChunk);
+        recordRange(chunk.commandBuffer, first, end);
+
+        VK_CHECK(vkEndCommandBuffer(chunk.commandBuffer));
+    });
+
+    std::vector<VkCommandBuffer> commandBuffers(activeChunks);
+    for (uint32_t i = 0; i < activeChunks; i++) {
+        commandBuffers[i] = chunks[i][frame].commandBuffer;
+    }
+    vkCmdExecuteCommands(primary, activeChunks, commandBuffers.data());
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "Vulkan.h"
+#include "ThreadPool.h"
+
+#include <functional>
+
+// Records one render pass worth of draws on several threads. Each chunk of the draw list
+// gets its own command pool per frame in flight and records a secondary command buffer,
+// which the primary runs with vkCmdExecuteCommands. Pools are reset wholesale when their
+// frame comes around again, so no per command buffer reset or free.
+//
+// Secondaries inherit the render pass and framebuffer but no other state: every chunk has
+// to bind the pipeline, dynamic state and buffers itself.
+struct VkParallelRecorder {
+    VkHandles *vk = nullptr;
+    ThreadPool *threads = nullptr;
+    uint32_t chunkCount = 0;
+
+    struct Chunk {
+        VkCommandPool commandPool;
+        VkCommandBuffer commandBuffer;
+    };
+    std::vector<std::array<Chunk, MAX_FRAMES_IN_FLIGHT>> chunks; // [chunk][frame]
+
+    // chunkCount 0 records one chunk per pool thread plus one for the caller
+    void init(VkHandles &vk, ThreadPool &threads, uint32_t chunkCount = 0);
+    void destroy();
+
+    // splits [0, drawCount) into contiguous ranges and calls recordRange(commandBuffer, first, end)
+    // for each one in parallel, then executes them in order on 'primary', which must be inside
+    // a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+    void record(VkCommandBuffer primary, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t frame, uint32_t drawCount,
+                std::function<void(VkCommandBuffer, uint32_t, uint32_t)> const &recordRange);
+};
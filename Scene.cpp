@@ -0,0 +1,183 @@
+#include "Scene.h"
+#include "Upload.h"
+#include "Record.h"
+#include "Profiler.h"
+#include "ObjLoader.h"
+#include "MeshCache.h"
+#include "Culling.h"
+#include "GpuCulling.h"
+#include "Texture.h"
+
+Model createModel(MeshArena &arena, VkUploadBatch &uploads, std::vector<Vertex> const &vertices, std::vector<uint32_t> const &indices) {
+    Model model{arena.add(uploads, vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size())};
+    model.setBounds(MeshBounds::of(vertices));
+    return model;
+}
+
+Model createModel(MeshArena &arena, VkUploadBatch &uploads, ObjMesh const &mesh) {
+    Model model;
+    if (mesh.shortIndices()) {
+        model.mesh = arena.add(uploads, mesh.vertices.data(), (uint32_t)mesh.vertices.size(), mesh.indices16.data(), (uint32_t)mesh.indices16.size());
+    } else {
+        model.mesh = arena.add(uploads, mesh.vertices.data(), (uint32_t)mesh.vertices.size(), mesh.indices32.data(), (uint32_t)mesh.indices32.size());
+    }
+    model.setBounds(MeshBounds::of(mesh.vertices));
+    return model;
+}
+
+Model createModel(MeshArena &arena, VkUploadBatch &uploads, MeshCacheFile const &cache) {
+    MeshCacheHeader const &h = *cache.header;
+    Model model;
+    if (h.indexType == VK_INDEX_TYPE_UINT16) {
+        model.mesh = arena.add(uploads, cache.vertices(), h.vertexCount, (uint16_t const *)cache.indices(), h.indexCount);
+    } else {
+        model.mesh = arena.add(uploads, cache.vertices(), h.vertexCount, (uint32_t const *)cache.indices(), h.indexCount);
+    }
+    model.setBounds(cache.bounds());
+    return model;
+}
+
+void bindDrawState(Vulkan &v, VkCommandBuffer commandBuffer, Scene &scene) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.render.graphicsPipeline);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float) v.present.swapChainExtent.width;
+    viewport.height = (float) v.present.swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = v.present.swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.render.pipelineLayout, 0, 1, &v.uniforms->descriptorSet, 1, &scene.uniformOffset);
+
+    // set 0 and the push constants carry over, the layouts agree on them. untextured until its pipeline has compiled
+    if (scene.textures) {
+        scene.textures->bind(commandBuffer, v.render.currentFrame);
+    }
+
+    // every model shares the arena's buffers: one bind, then only offset draws
+    scene.arena.bind(commandBuffer);
+}
+
+void drawInstancedModels(Vulkan &v, VkCommandBuffer commandBuffer, Scene &scene) {
+    if (scene.instancedModels.empty()) {
+        return;
+    }
+    // binding 0 is still the arena's vertex buffer from bindDrawState
+    InstanceBuffer &instances = *scene.instanceBuffer;
+    instances.begin(v.render.currentFrame);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.render.instancedPipeline);
+    instances.bind(commandBuffer);
+    for (auto &model : scene.instancedModels) {
+        DrawPushConstants constants{model.meshTransform};
+        vkCmdPushConstants(commandBuffer, v.render.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+        uint32_t firstInstance = instances.push(model.instances.data(), (uint32_t)model.instances.size());
+        scene.arena.draw(commandBuffer, model.mesh, (uint32_t)model.instances.size(), firstInstance);
+    }
+}
+
+// what this frame draws: every model, or the ones the culler kept
+static uint32_t drawCount(Scene &scene) {
+    return scene.culler ? (uint32_t)scene.culler->visible.size() : (uint32_t)scene.models.size();
+}
+
+static Model &drawModel(Scene &scene, uint32_t i) {
+    return scene.culler ? scene.models[scene.culler->visible[i]] : scene.models[i];
+}
+
+void recordCommandBuffer(Vulkan &v, uint32_t frameIndex, Scene &scene) {
+    // indirect is a single call already, nothing to gain from splitting it across threads
+    bool parallel = scene.parallel && !scene.indirect && !scene.gpuCuller;
+    VkSubpassContents contents = parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+    VkGpuProfiler *profiler = scene.profiler;
+    scene.uniformOffset = v.uniforms->push(scene.uniforms);
+    if (scene.culler && !scene.gpuCuller) {
+        scene.culler->cull(scene.models, scene.uniforms.proj * scene.uniforms.view);
+    }
+    VkCommandBuffer commandBuffer = v.render.beginCommandBuffer();
+    uint32_t renderPassSection = UINT32_MAX;
+    if (profiler) {
+        profiler->beginFrame(commandBuffer, v.render.currentFrame);
+    }
+    // the compute queue has no timestamps of its own here, only graphics queue culling gets a section
+    glm::mat4 viewProj = scene.uniforms.proj * scene.uniforms.view;
+    if (scene.gpuCuller && !(scene.compute && scene.gpuCuller->cullAsync(v, *scene.compute, v.render.currentFrame, viewProj))) {
+        uint32_t cullSection = profiler ? profiler->beginSection(commandBuffer, "gpucull") : UINT32_MAX;
+        scene.gpuCuller->cull(commandBuffer, v.render.currentFrame, viewProj);
+        if (profiler) {
+            profiler->endSection(commandBuffer, cullSection);
+        }
+    }
+    if (profiler) {
+        renderPassSection = profiler->beginSection(commandBuffer, "renderpass");
+    }
+    v.render.beginRenderpass(commandBuffer, v.present, frameIndex, contents); {
+        if (parallel) {
+            scene.parallel->record(commandBuffer, v.render.renderPass, v.render.swapChainFramebuffers[frameIndex], v.render.currentFrame, drawCount(scene),
+                [&](VkCommandBuffer secondary, uint32_t first, uint32_t end) {
+                    bindDrawState(v, secondary, scene);
+                    for (uint32_t i = first; i < end; i++) {
+                        drawModel(scene, i).draw(secondary, scene.arena, v.render.pipelineLayout);
+                    }
+                    // only the first chunk starts at 0, it takes the instanced draws as well
+                    if (first == 0) {
+                        drawInstancedModels(v, secondary, scene);
+                    }
+                });
+        } else {
+            if (profiler) {
+                profiler->beginStatistics(commandBuffer);
+            }
+            bindDrawState(v, commandBuffer, scene);
+            if (scene.gpuCuller) {
+                scene.gpuCuller->draw(commandBuffer, v.render.currentFrame, v.uniforms->descriptorSet, scene.uniformOffset);
+            } else if (scene.indirect) {
+                scene.indirect->begin(v.render.currentFrame);
+                for (uint32_t i = 0; i < drawCount(scene); i++) {
+                    Model &model = drawModel(scene, i);
+                    scene.indirect->add(scene.arena, model.mesh, model.transform * model.meshTransform);
+                }
+                scene.indirect->draw(commandBuffer, v.uniforms->descriptorSet, scene.uniformOffset);
+            } else {
+                for (uint32_t i = 0; i < drawCount(scene); i++) {
+                    drawModel(scene, i).draw(commandBuffer, scene.arena, v.render.pipelineLayout);
+                }
+            }
+            drawInstancedModels(v, commandBuffer, scene);
+            if (profiler) {
+                profiler->endStatistics(commandBuffer);
+            }
+        }
+    } vkCmdEndRenderPass(commandBuffer);
+    if (profiler) {
+        profiler->endSection(commandBuffer, renderPassSection);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+void drawFrame(Vulkan &v, Scene &scene) {
+    auto &h = v.handles;
+    auto &r = v.render;
+
+    uint32_t imageIndex = v.waitAndPrepForNextFrame();
+    if (scene.profiler) {
+        scene.profiler->collect(v.render.currentFrame);
+        scene.profiler->cpuWaitMs.add(v.cpuWaitMs);
+    }
+    if (scene.textures) {
+        scene.textures->update(v);
+    }
+    scene.arena.reclaim(v);
+    recordCommandBuffer(v, imageIndex, scene);
+
+    v.submitAndPresent(imageIndex);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "Vulkan.h"
+#include "Mesh.h"
+#include "Uniforms.h"
+#include "VertexFormat.h"
+
+#include <limits>
+#include <vector>
+
+struct VkUploadBatch;
+struct VkParallelRecorder;
+struct VkGpuProfiler;
+struct ObjMesh;
+struct MeshCacheFile;
+struct FrustumCuller;
+struct VkGpuCuller;
+struct VkComputeQueue;
+struct VkTextureSet;
+
+// a model is a mesh in the shared MeshArena (see MeshArena::get for its offsets) plus where it is.
+// moving it is just a new transform, it goes to the shader as a push constant
+struct Model {
+    uint32_t mesh;
+    glm::mat4 transform = glm::mat4(1.0f);
+    glm::mat4 meshTransform = glm::mat4(1.0f); // maps quantized positions back to the mesh's bounds, see MeshBounds::dequantize
+    glm::vec3 boundsCenter = glm::vec3(0.0f);  // bounding sphere in model space (before transform), for FrustumCuller
+    float boundsRadius = std::numeric_limits<float>::infinity(); // never culled until set
+
+    void setBounds(MeshBounds const &bounds) {
+        boundsCenter = bounds.center;
+        boundsRadius = glm::length(bounds.halfExtent);
+    }
+
+    void draw(VkCommandBuffer commandBuffer, MeshArena &arena, VkPipelineLayout pipelineLayout) {
+        DrawPushConstants constants{transform * meshTransform};
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+        arena.draw(commandBuffer, mesh);
+    }
+};
+
+// the model is drawable once 'uploads' has been submitted, which Vulkan::uploads() does ahead of the frame's draws
+Model createModel(MeshArena &arena, VkUploadBatch &uploads, std::vector<Vertex> const &vertices, std::vector<uint32_t> const &indices);
+
+// a loaded OBJ, its 16 or 32 bit indices are converted if the arena uses the other type
+Model createModel(MeshArena &arena, VkUploadBatch &uploads, ObjMesh const &mesh);
+
+// straight from the mapped cache into the staging ring
+Model createModel(MeshArena &arena, VkUploadBatch &uploads, MeshCacheFile const &cache);
+
+// same, converting to the arena's packed vertex format V on the way in. arena must have been created with sizeof(V)
+template <typename V, typename Index>
+Model createPackedModel(MeshArena &arena, VkUploadBatch &uploads, Vertex const *vertices, uint32_t vertexCount, Index const *indices, uint32_t indexCount, MeshBounds const &bounds) {
+    std::vector<V> packed = encodeVertices<V>(vertices, vertexCount, bounds);
+    Model model{arena.add(uploads, packed.data(), vertexCount, indices, indexCount)};
+    model.setBounds(bounds);
+    if constexpr (V::quantizedPosition) {
+        model.meshTransform = bounds.dequantize();
+    }
+    return model;
+}
+
+template <typename V, typename Index = uint32_t>
+Model createPackedModel(MeshArena &arena, VkUploadBatch &uploads, std::vector<Vertex> const &vertices, std::vector<Index> const &indices) {
+    return createPackedModel<V>(arena, uploads, vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size(), MeshBounds::of(vertices));
+}
+
+// one mesh drawn instances.size() times with a single draw call, see InstanceBuffer
+struct InstancedModel {
+    uint32_t mesh;
+    glm::mat4 meshTransform = glm::mat4(1.0f); // applied before each instance's transform, see Model::meshTransform
+    std::vector<InstanceData> instances;
+};
+
+// what gets drawn each frame and how
+struct Scene {
+    MeshArena arena;
+    std::vector<Model> models;
+    std::vector<InstancedModel> instancedModels; // needs instanceBuffer and Vulkan::render.instancedPipeline
+    InstanceBuffer *instanceBuffer = nullptr;
+    FrameUniforms uniforms;              // view/proj, written to the uniform ring each frame
+    uint32_t uniformOffset = 0;          // this frame's dynamic offset for them
+    IndirectDraws *indirect = nullptr;   // set: draws are written to the gpu and issued with one indirect call, transforms through its storage buffer
+    VkParallelRecorder *parallel = nullptr; // set: models are split across threads into secondary command buffers
+    FrustumCuller *culler = nullptr;     // set: only models inside the view frustum are drawn, instanced models are not culled
+    VkGpuCuller *gpuCuller = nullptr;    // set: models are culled and drawn on the gpu from its object buffer instead, see VkGpuCuller::setObjects. takes precedence over culler, indirect and parallel
+    VkComputeQueue *compute = nullptr;   // set: gpuCuller culls on this queue when it can, overlapping the previous frame's rendering
+    VkTextureSet *textures = nullptr;    // set: models draw with its textured pipeline, updated once a frame by drawFrame
+    VkGpuProfiler *profiler = nullptr;
+};
+
+// pipeline, dynamic state, the frame's uniforms and the arena's buffers, needed at the start of every primary or secondary command buffer
+void bindDrawState(Vulkan &v, VkCommandBuffer commandBuffer, Scene &scene);
+
+// binds the instanced pipeline and the frame's instance data, then one draw per InstancedModel
+void drawInstancedModels(Vulkan &v, VkCommandBuffer commandBuffer, Scene &scene);
+
+// records the frame's render pass into the current frame's command buffer
+void recordCommandBuffer(Vulkan &v, uint32_t frameIndex, Scene &scene);
+
+// wait for the frame's slot, record and submit it
+void drawFrame(Vulkan &v, Scene &scene);
@@ -0,0 +1,319 @@
+#include "Texture.h"
+#include "ThreadPool.h"
+#include "Upload.h"
+#include "Uniforms.h"
+#include "PipelineCompiler.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <iostream>
+
+static uint32_t mipLevelsFor(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    while ((width | height) >> levels) {
+        levels++;
+    }
+    return levels;
+}
+
+void VkTextureSet::init(Vulkan &vulkan, ThreadPool &threads, uint32_t capacity, char const *vertexShader, char const *fragmentShader, VkPipelineCompiler *compiler, VkDeviceSize uploadBytesPerFrame) {
+    VkHandles &vk = vulkan.handles;
+    this->vk = &vk;
+    this->threads = &threads;
+    this->capacity = capacity;
+    this->uploadBytesPerFrame = uploadBytesPerFrame;
+    textures.assign(capacity, Texture{});
+    stats = TextureStats{};
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(vk.physicalDevice, TEXTURE_FORMAT, &formatProperties);
+    VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    mipmapped = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    VK_CHECK(vkCreateSampler(vk.device, &samplerInfo, nullptr, &sampler));
+
+    // goes out with the first frame's uploads, ahead of its draws like everything else
+    uint32_t white = 0xffffffff;
+    placeholder = createTexture(1, 1, 1);
+    vulkan.uploads().uploadImage(&white, sizeof(white), placeholder.parts.image, {1, 1, 1}, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = capacity;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = 1;
+    setLayoutInfo.pBindings = &binding;
+    VK_CHECK(vkCreateDescriptorSetLayout(vk.device, &setLayoutInfo, nullptr, &setLayout));
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = capacity * MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    VK_CHECK(vkCreateDescriptorPool(vk.device, &poolInfo, nullptr, &descriptorPool));
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    for (auto &f : frames) {
+        VK_CHECK(vkAllocateDescriptorSets(vk.device, &allocInfo, &f.set));
+        f.written.assign(capacity, VK_NULL_HANDLE);
+        writeSet(f);
+    }
+
+    // same push constants as VkRender::pipelineLayout so Model::draw works unchanged with this pipeline bound
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawPushConstants);
+    VkDescriptorSetLayout setLayouts[] = {vulkan.render.descriptorSetLayout, setLayout};
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 2;
+    layoutInfo.pSetLayouts = setLayouts;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK(vkCreatePipelineLayout(vk.device, &layoutInfo, nullptr, &pipelineLayout));
+    if (compiler) {
+        pendingPipeline = compiler->request(pipelineLayout, vertexShader, fragmentShader);
+    } else {
+        pipeline = createPipelineWithLayout(vulkan, pipelineLayout, vertexShader, fragmentShader);
+    }
+}
+
+void VkTextureSet::destroy() {
+    {
+        // the jobs write into this object, let them finish
+        std::unique_lock<std::mutex> lock(decodedMutex);
+        decodeFinished.wait(lock, [this] { return decodesInFlight == 0; });
+        for (auto &d : decoded) {
+            stbi_image_free(d.pixels);
+        }
+        decoded.clear();
+    }
+    if (pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(vk->device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(vk->device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(vk->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(vk->device, setLayout, nullptr);
+    for (auto &texture : textures) {
+        destroyTexture(texture);
+    }
+    for (auto &r : retired) {
+        destroyTexture(r.first);
+    }
+    retired.clear();
+    destroyTexture(placeholder);
+    vkDestroySampler(vk->device, sampler, nullptr);
+}
+
+Texture VkTextureSet::createTexture(uint32_t width, uint32_t height, uint32_t mipLevels) {
+    Texture texture;
+    texture.width = width;
+    texture.height = height;
+    texture.mipLevels = mipLevels;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = TEXTURE_FORMAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // the blits read the levels above
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vk->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.parts.image, texture.parts.mem);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = texture.parts.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = TEXTURE_FORMAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = mipLevels;
+    viewInfo.subresourceRange.layerCount = 1;
+    VK_CHECK(vkCreateImageView(vk->device, &viewInfo, nullptr, &texture.parts.view));
+    return texture;
+}
+
+void VkTextureSet::destroyTexture(Texture &texture) {
+    if (texture.parts.image == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyImageView(vk->device, texture.parts.view, nullptr);
+    vk->destroyImage(texture.parts.image, texture.parts.mem);
+    texture = Texture{};
+}
+
+void VkTextureSet::load(uint32_t slot, std::string const &path) {
+    if (slot >= capacity) {
+        throw std::runtime_error("texture slot " + std::to_string(slot) + " out of range, capacity is " + std::to_string(capacity));
+    }
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        if (decodesInFlight == 0 && decoded.empty()) {
+            loadStart = std::chrono::high_resolution_clock::now();
+        }
+        decodesInFlight++;
+        stats.requested++;
+    }
+    threads->submit([this, slot, path] {
+        auto start = std::chrono::high_resolution_clock::now();
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        auto end = std::chrono::high_resolution_clock::now();
+        if (!pixels) {
+            std::cout << "failed to load texture " << path << ": " << stbi_failure_reason() << "\n";
+        }
+
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        stats.decodeThreadMs += std::chrono::duration<double, std::milli>(end - start).count();
+        if (pixels) {
+            decoded.push_back({slot, (uint32_t)width, (uint32_t)height, pixels});
+            stats.decoded++;
+            stats.decodedBytes += (uint64_t)width * height * 4;
+        } else {
+            stats.failed++;
+        }
+        decodesInFlight--;
+        if (decodesInFlight == 0) {
+            stats.decodeWallMs = std::chrono::duration<double, std::milli>(end - loadStart).count();
+            decodeFinished.notify_all();
+        }
+    });
+}
+
+bool VkTextureSet::loading() {
+    std::lock_guard<std::mutex> lock(decodedMutex);
+    return decodesInFlight > 0 || !decoded.empty();
+}
+
+void VkTextureSet::update(Vulkan &vulkan) {
+    uint64_t completed = vulkan.completedFrames();
+    auto done = std::partition(retired.begin(), retired.end(), [completed](auto const &r) { return r.second > completed; });
+    for (auto it = done; it != retired.end(); it++) {
+        destroyTexture(it->first);
+    }
+    retired.erase(done, retired.end());
+
+    // take what fits this frame's budget, the rest waits for the next frames
+    std::vector<Decoded> ready;
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        VkDeviceSize bytes = 0;
+        size_t taken = 0;
+        while (taken < decoded.size()) {
+            VkDeviceSize size = (VkDeviceSize)decoded[taken].width * decoded[taken].height * 4;
+            if (taken > 0 && bytes + size > uploadBytesPerFrame) {
+                break;
+            }
+            bytes += size;
+            taken++;
+        }
+        ready.assign(decoded.begin(), decoded.begin() + taken);
+        decoded.erase(decoded.begin(), decoded.begin() + taken);
+    }
+
+    if (!ready.empty()) {
+        auto start = std::chrono::high_resolution_clock::now();
+        VkUploadBatch &uploads = vulkan.uploads();
+        for (auto &d : ready) {
+            uint32_t mipLevels = mipmapped ? mipLevelsFor(d.width, d.height) : 1;
+            Texture texture = createTexture(d.width, d.height, mipLevels);
+            VkDeviceSize size = (VkDeviceSize)d.width * d.height * 4;
+            VkExtent3D extent{d.width, d.height, 1};
+            if (mipmapped) {
+                uploads.uploadImage(d.pixels, size, texture.parts.image, extent, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                uploads.generateMipmaps(texture.parts.image, extent, mipLevels);
+            } else {
+                uploads.uploadImage(d.pixels, size, texture.parts.image, extent, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+            stbi_image_free(d.pixels);
+
+            // frames already submitted may still sample the old image, it goes once they are all done
+            Texture &slot = textures[d.slot];
+            if (slot.parts.image != VK_NULL_HANDLE) {
+                retired.push_back({slot, vulkan.frameNumber});
+                // a later view can get the retired one's handle value back, writeSet must not take that for up to date
+                for (auto &f : frames) {
+                    f.written[d.slot] = VK_NULL_HANDLE;
+                }
+            } else {
+                stats.resident++;
+            }
+            slot = texture;
+            stats.uploadedBytes += size;
+        }
+        stats.uploadFrames++;
+        stats.uploadMs.add(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+
+    // the frame's uploads are submitted ahead of its draws, so everything staged above can be sampled this frame
+    writeSet(frames[vulkan.render.currentFrame]);
+}
+
+void VkTextureSet::writeSet(Frame &frame) {
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    std::vector<VkWriteDescriptorSet> writes;
+    imageInfos.reserve(capacity);
+    for (uint32_t i = 0; i < capacity; i++) {
+        VkImageView view = textures[i].parts.image != VK_NULL_HANDLE ? textures[i].parts.view : placeholder.parts.view;
+        if (frame.written[i] == view) {
+            continue;
+        }
+        frame.written[i] = view;
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = sampler;
+        imageInfo.imageView = view;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos.push_back(imageInfo);
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = frame.set;
+        write.dstBinding = 0;
+        write.dstArrayElement = i;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfos.back();
+        writes.push_back(write);
+    }
+    if (!writes.empty()) {
+        vkUpdateDescriptorSets(vk->device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+    }
+}
+
+bool VkTextureSet::bind(VkCommandBuffer commandBuffer, uint32_t frame) {
+    VkPipeline textured = pendingPipeline ? pendingPipeline->get() : pipeline;
+    if (textured == VK_NULL_HANDLE) {
+        return false;
+    }
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, textured);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &frames[frame].set, 0, nullptr);
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "Vulkan.h"
+#include "Profiler.h"
+
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ThreadPool;
+struct VkPipelineCompiler;
+struct VkPendingPipeline;
+
+#define TEXTURE_FORMAT VK_FORMAT_R8G8B8A8_SRGB // every image is decoded to 8 bit rgba
+
+// A resident texture: the image with its full mip chain, sampled through VkTextureSet::sampler
+struct Texture {
+    VkImageParts parts{};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 1;
+};
+
+struct TextureStats {
+    uint32_t requested = 0;
+    uint32_t decoded = 0;
+    uint32_t failed = 0;
+    uint32_t resident = 0;
+    uint64_t decodedBytes = 0;    // rgba level 0, what gets uploaded
+    double decodeWallMs = 0;      // load() until the last decode finished
+    double decodeThreadMs = 0;    // summed over the workers
+    uint64_t uploadedBytes = 0;
+    uint32_t uploadFrames = 0;    // frames that uploaded anything
+    RollingStats uploadMs;        // cpu time per uploading frame: image creation, staging copies, recording
+
+    double decodeMBps() const {
+        return decodeWallMs > 0 ? decodedBytes / (1024.0 * 1024.0) / (decodeWallMs / 1000.0) : 0;
+    }
+};
+
+// A fixed number of sampled texture slots behind one descriptor set layout, set 1 of
+// pipelineLayout: binding 0 is a combined image sampler array of capacity entries.
+// load() hands PNG/JPG decoding (stb_image) to the thread pool and returns right away.
+// update(), once per frame after waitAndPrepForNextFrame, moves decoded images onto the
+// GPU through the frame's VkUploadBatch, at most uploadBytesPerFrame a frame (one image
+// minimum, so big ones still make progress) so a big texture set streams in over
+// several frames instead of stalling one. The mip chain is built on the GPU with
+// blits in the same batch (VkUploadBatch::generateMipmaps).
+// Slots that aren't resident yet sample a 1x1 white placeholder. Descriptor sets are per
+// frame slot and only rewritten when their slot comes round again, so a set is never
+// changed while a frame in flight still uses it; replaced images are kept until then too.
+struct VkTextureSet {
+    VkHandles *vk = nullptr;
+    ThreadPool *threads = nullptr;
+    uint32_t capacity = 0;
+    VkDeviceSize uploadBytesPerFrame = 0;
+    bool mipmapped = true; // false when TEXTURE_FORMAT can't be blitted/linearly filtered, textures get a single level
+
+    std::vector<Texture> textures; // [capacity], parts.image null until resident
+    Texture placeholder;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE; // set 0 the frame uniforms, set 1 the textures, DrawPushConstants like VkRender::pipelineLayout
+    VkPipeline pipeline = VK_NULL_HANDLE;             // textured version of VkRender::graphicsPipeline, unless compiled in the background:
+    VkPendingPipeline *pendingPipeline = nullptr;     // owned by the VkPipelineCompiler
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    struct Frame {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        std::vector<VkImageView> written; // what each slot of set points at
+    };
+    std::array<Frame, MAX_FRAMES_IN_FLIGHT> frames;
+    std::vector<std::pair<Texture, uint64_t>> retired; // replaced textures and the frame count after which nothing samples them
+
+    // filled by the decode jobs, drained by update()
+    struct Decoded {
+        uint32_t slot;
+        uint32_t width, height;
+        unsigned char *pixels; // stbi_image_free'd once staged
+    };
+    std::mutex decodedMutex;
+    std::condition_variable decodeFinished;
+    std::vector<Decoded> decoded;
+    uint32_t decodesInFlight = 0;
+    std::chrono::high_resolution_clock::time_point loadStart;
+
+    TextureStats stats;
+
+    // with a compiler the pipeline builds in the background and bind() falls back until it's ready
+    void init(Vulkan &vulkan, ThreadPool &threads, uint32_t capacity, char const *vertexShader, char const *fragmentShader, VkPipelineCompiler *compiler = nullptr, VkDeviceSize uploadBytesPerFrame = 8 * 1024 * 1024);
+    void destroy(); // after the device is idle
+
+    // queues the decode of path into slot, returns immediately. a slot loaded again keeps its old image until the new one is resident
+    void load(uint32_t slot, std::string const &path);
+    // stages what finished decoding into vulkan.uploads() and points the current frame's set at everything resident
+    void update(Vulkan &vulkan);
+    bool loading();
+
+    // after the frame uniforms are bound with VkRender::pipelineLayout (compatible for set 0 and the push constants).
+    // false while the pipeline is still compiling: nothing is bound, the caller's pipeline draws untextured
+    bool bind(VkCommandBuffer commandBuffer, uint32_t frame);
+
+private:
+    Texture createTexture(uint32_t width, uint32_t height, uint32_t mipLevels);
+    void destroyTexture(Texture &texture);
+    void writeSet(Frame &frame);
+};
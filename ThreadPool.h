@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs off one queue. parallelFor is the
+// fork/join helper most callers want; submit is for fire and forget work.
+struct ThreadPool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+
+    // with 0 workers parallelFor simply runs on the calling thread
+    void init(uint32_t threadCount = defaultThreadCount());
+    void destroy(); // finishes queued jobs, then joins. safe to call again, or on a pool that never started
+    ~ThreadPool() {
+        destroy(); // joinable std::threads would terminate the process
+    }
+
+    void submit(std::function<void()> job);
+
+    // runs task(i) for every i in [0, count) and returns once all of them finished.
+    // the calling thread works through indices too, so this never deadlocks on a busy pool.
+    void parallelFor(uint32_t count, std::function<void(uint32_t)> const &task);
+
+    // one worker per hardware thread, minus the caller's
+    static uint32_t defaultThreadCount() {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    uint32_t size() const {
+        return (uint32_t)workers.size();
+    }
+
+private:
+    void workerLoop();
+};
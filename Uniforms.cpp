@@ -0,0 +1,83 @@
+#include "Uniforms.h"
+
+void VkUniformRing::init(VkHandles &vk, VkDescriptorSetLayout layout, VkDeviceSize bytesPerFrame, uint32_t frameCount) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vk.physicalDevice, &properties);
+    alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+    // every region keeps room for a full block past its last offset, so a dynamic offset can never read past the buffer
+    this->bytesPerFrame = (bytesPerFrame + alignment - 1) / alignment * alignment;
+    vk.createBuffer(this->bytesPerFrame * frameCount + UNIFORM_BLOCK_RANGE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+    frame = 0;
+    head = 0;
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSize.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    VK_CHECK(vkCreateDescriptorPool(vk.device, &poolInfo, nullptr, &descriptorPool));
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+    VK_CHECK(vkAllocateDescriptorSets(vk.device, &allocInfo, &descriptorSet));
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = UNIFORM_BLOCK_RANGE;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(vk.device, 1, &write, 0, nullptr);
+}
+
+void VkUniformRing::destroy(VkHandles &vk) {
+    vkDestroyDescriptorPool(vk.device, descriptorPool, nullptr);
+    vk.destroyBuffer(buffer, memory);
+}
+
+void VkUniformRing::beginFrame(uint32_t frameIdx) {
+    frame = frameIdx;
+    head = 0;
+}
+
+uint32_t VkUniformRing::alloc(VkDeviceSize size, void *&ptr) {
+    if (size > UNIFORM_BLOCK_RANGE) {
+        throw std::runtime_error("uniform block of " + std::to_string(size) + " bytes is bigger than UNIFORM_BLOCK_RANGE");
+    }
+    if (head + size > bytesPerFrame) {
+        throw std::runtime_error("out of uniform memory for this frame, raise DEFAULT_UNIFORM_BYTES_PER_FRAME");
+    }
+    VkDeviceSize offset = frame * bytesPerFrame + head;
+    head = (head + size + alignment - 1) / alignment * alignment;
+    ptr = (char *)memory.mapped + offset;
+    return (uint32_t)offset;
+}
+
+void createUniformRing(Vulkan &vulkan, VkDeviceSize bytesPerFrame) {
+    vulkan.uniforms = new VkUniformRing();
+    vulkan.uniforms->init(vulkan.handles, vulkan.render.descriptorSetLayout, bytesPerFrame, vulkan.render.framesInFlight);
+}
+
+void destroyUniformRing(Vulkan &vulkan) {
+    vulkan.uniforms->destroy(vulkan.handles);
+    delete vulkan.uniforms;
+    vulkan.uniforms = nullptr;
+}
+
+void Vulkan::recycleFrameUniforms() {
+    uniforms->beginFrame(render.currentFrame);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "Vulkan.h"
+
+#define DEFAULT_UNIFORM_BYTES_PER_FRAME (256 * 1024)
+#define UNIFORM_BLOCK_RANGE 256 // largest block one dynamic offset can address, see VkUniformRing::alloc
+
+// set 0 binding 0 of every pipeline, written once per frame
+struct FrameUniforms {
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 proj = glm::mat4(1.0f);
+};
+
+// per draw, vertex stage push constants
+struct DrawPushConstants {
+    glm::mat4 model = glm::mat4(1.0f);
+};
+
+// Persistently mapped uniform buffer carved into a region per frame in flight, like
+// VkStagingRing. Everything is reached through one VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+// descriptor covering UNIFORM_BLOCK_RANGE bytes: alloc() returns the dynamic offset to pass
+// to vkCmdBindDescriptorSets, so the descriptor set never has to be rewritten.
+// Not thread safe, allocate before fanning recording out to worker threads.
+struct VkUniformRing {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkAllocation memory;
+    VkDeviceSize bytesPerFrame = 0;
+    VkDeviceSize alignment = 0; // minUniformBufferOffsetAlignment
+    uint32_t frame = 0;
+    VkDeviceSize head = 0;
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    void init(VkHandles &vk, VkDescriptorSetLayout layout, VkDeviceSize bytesPerFrame, uint32_t frameCount = MAX_FRAMES_IN_FLIGHT);
+    void destroy(VkHandles &vk);
+    void beginFrame(uint32_t frameIdx);
+
+    // size must be <= UNIFORM_BLOCK_RANGE, returns the dynamic offset and where to write the data
+    uint32_t alloc(VkDeviceSize size, void *&ptr);
+    template <typename T>
+    uint32_t push(T const &data) {
+        void *ptr;
+        uint32_t offset = alloc(sizeof(T), ptr);
+        memcpy(ptr, &data, sizeof(T));
+        return offset;
+    }
+};
+
+// creates Vulkan::uniforms with a set allocated against render.descriptorSetLayout
+void createUniformRing(Vulkan &vulkan, VkDeviceSize bytesPerFrame);
+void destroyUniformRing(Vulkan &vulkan);
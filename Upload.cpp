@@ -0,0 +1,473 @@
+#include "Upload.h"
+
+#include <algorithm>
+
+void VkStagingRing::init(VkHandles &vk, VkDeviceSize bytesPerFrame, uint32_t frameCount) {
+    this->bytesPerFrame = bytesPerFrame;
+    this->frameCount = frameCount;
+    vk.createBuffer(bytesPerFrame * frameCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+    heads.assign(frameCount, 0);
+}
+
+void VkStagingRing::destroy(VkHandles &vk) {
+    vk.destroyBuffer(buffer, memory);
+    buffer = VK_NULL_HANDLE;
+}
+
+bool VkStagingRing::alloc(uint32_t region, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset, void *&ptr) {
+    VkDeviceSize &head = heads[region];
+    VkDeviceSize aligned = (head + alignment - 1) / alignment * alignment;
+    if (aligned + size > bytesPerFrame) {
+        overflowBytes += size;
+        return false;
+    }
+    head = aligned + size;
+    peakFrameBytes = std::max(peakFrameBytes, head);
+
+    offset = (VkDeviceSize)region * bytesPerFrame + aligned;
+    ptr = (char *)memory.mapped + offset;
+    return true;
+}
+
+void VkUploadBatch::init(VkHandles &vk, VkStagingRing *ring, uint32_t ringRegion) {
+    this->vk = &vk;
+    this->ring = ring;
+    this->ringRegion = ringRegion;
+    commandPool = vk.createCommandPool();
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocInfo, &commandBuffer));
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_CHECK(vkCreateFence(vk.device, &fenceInfo, nullptr, &fence));
+
+    async = vk.asyncTransfer();
+    if (async) {
+        VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocInfo, &acquireCommandBuffer));
+        transferPool = vk.createCommandPool(vk.transferFamily);
+        allocInfo.commandPool = transferPool;
+        VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocInfo, &transferCommandBuffer));
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VK_CHECK(vkCreateSemaphore(vk.device, &semaphoreInfo, nullptr, &transferDone));
+    }
+}
+
+void VkUploadBatch::destroy() {
+    if (submitted) {
+        wait();
+    }
+    vkDestroyFence(vk->device, fence, nullptr);
+    vkFreeCommandBuffers(vk->device, commandPool, 1, &commandBuffer);
+    if (async) {
+        vkFreeCommandBuffers(vk->device, commandPool, 1, &acquireCommandBuffer);
+        vkFreeCommandBuffers(vk->device, transferPool, 1, &transferCommandBuffer);
+        vkDestroyCommandPool(vk->device, transferPool, nullptr);
+        vkDestroySemaphore(vk->device, transferDone, nullptr);
+    }
+    vkDestroyCommandPool(vk->device, commandPool, nullptr);
+}
+
+void VkUploadBatch::begin() {
+    if (recording) {
+        return;
+    }
+    if (submitted) {
+        throw std::runtime_error("upload batch is still in flight, wait() before recording more copies");
+    }
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    recording = true;
+}
+
+VkCommandBuffer VkUploadBatch::beginStaging() {
+    if (!async) {
+        begin();
+        return commandBuffer;
+    }
+    if (!transferRecording) {
+        if (submitted) {
+            throw std::runtime_error("upload batch is still in flight, wait() before recording more copies");
+        }
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(transferCommandBuffer, &beginInfo));
+        transferRecording = true;
+    }
+    return transferCommandBuffer;
+}
+
+VkDeviceSize VkUploadBatch::stage(void const *data, VkDeviceSize size, VkBuffer &stagingBuffer) {
+    // 16 covers the texel size/4 byte alignment buffer to image copies need
+    VkDeviceSize offset;
+    void *ptr;
+    if (ring && ring->alloc(ringRegion, size, 16, offset, ptr)) {
+        memcpy(ptr, data, (size_t) size);
+        stagingBuffer = ring->buffer;
+        return offset;
+    }
+
+    StagingBuffer staging;
+    vk->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging.buffer, staging.memory);
+    memcpy(staging.memory.mapped, data, (size_t) size);
+    stagingBuffers.push_back(staging);
+    stagingBuffer = staging.buffer;
+    return 0;
+}
+
+void VkUploadBatch::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset) {
+    begin();
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    bytesUploaded += size;
+    copyCount++;
+}
+
+void VkUploadBatch::copySharedBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset) {
+    VkCommandBuffer commandBuffer = beginStaging();
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    bytesUploaded += size;
+    copyCount++;
+}
+
+void VkUploadBatch::copyBufferToImage(VkBuffer srcBuffer, VkImage dstImage, VkExtent3D extent, VkImageLayout finalLayout, VkDeviceSize srcOffset) {
+    VkCommandBuffer commandBuffer = beginStaging();
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = dstImage;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = srcOffset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = extent;
+    vkCmdCopyBufferToImage(commandBuffer, srcBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    if (async) {
+        // the release to graphics does the final transition, see submit()
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = finalLayout;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = vk->transferFamily;
+        barrier.dstQueueFamilyIndex = vk->graphicsFamily;
+        releasedImages.push_back(barrier);
+    } else if (finalLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = finalLayout;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+    copyCount++;
+}
+
+void VkUploadBatch::generateMipmaps(VkImage image, VkExtent3D extent, uint32_t mipLevels) {
+    begin();
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.layerCount = 1;
+
+    // the levels below 0 have never been written
+    if (mipLevels > 1) {
+        barrier.subresourceRange.baseMipLevel = 1;
+        barrier.subresourceRange.levelCount = mipLevels - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+    barrier.subresourceRange.levelCount = 1;
+
+    int32_t width = (int32_t)extent.width, height = (int32_t)extent.height;
+    for (uint32_t level = 1; level < mipLevels; level++) {
+        // the level above was just written (copy or blit), read it
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        int32_t nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = {width, height, 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    // the last level was only ever written
+    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void VkUploadBatch::transferBarrier() {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    // with async transfer each queue's copies are ordered on their own, the acquire orders the transfer queue's before graphics'.
+    // the transfer side is always recorded, its first sync scope also covers earlier batches' copies on that queue
+    if (!async || recording) {
+        begin();
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+    if (async) {
+        vkCmdPipelineBarrier(beginStaging(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+}
+
+void VkUploadBatch::uploadBuffer(void const *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset, bool shared) {
+    VkBuffer stagingBuffer;
+    VkDeviceSize stagingOffset = stage(data, size, stagingBuffer);
+    VkCommandBuffer commandBuffer = beginStaging();
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = stagingOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+    bytesUploaded += size;
+    copyCount++;
+
+    // shared buffers are valid on every family, transferDone alone makes the write visible to graphics
+    if (async && !shared) {
+        VkBufferMemoryBarrier release{};
+        release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        release.dstAccessMask = 0;
+        release.srcQueueFamilyIndex = vk->transferFamily;
+        release.dstQueueFamilyIndex = vk->graphicsFamily;
+        release.buffer = dstBuffer;
+        release.offset = dstOffset;
+        release.size = size;
+        releasedBuffers.push_back(release);
+    }
+}
+
+void VkUploadBatch::uploadImage(void const *data, VkDeviceSize size, VkImage dstImage, VkExtent3D extent, VkImageLayout finalLayout) {
+    VkBuffer stagingBuffer;
+    VkDeviceSize stagingOffset = stage(data, size, stagingBuffer);
+    copyBufferToImage(stagingBuffer, dstImage, extent, finalLayout, stagingOffset);
+    bytesUploaded += size;
+}
+
+// everything an upload can be read by, stages and accesses
+static const VkPipelineStageFlags UPLOAD_CONSUMER_STAGES = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+static const VkAccessFlags UPLOAD_CONSUMER_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+void VkUploadBatch::submit() {
+    bool transfer = async && transferRecording;
+    if (!recording && !transfer) {
+        return; // nothing recorded
+    }
+
+    if (transfer) {
+        submitAsync();
+        begin(); // the graphics submit carries the fence and the final barrier even without device copies
+    }
+
+    // make the copies visible to everything that reads them later in submission order on this queue
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_CONSUMER_STAGES, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+    recording = false;
+
+    // the acquires have to run before the device copies, those may read what the transfer queue wrote
+    VkCommandBuffer commandBuffers[] = {acquireCommandBuffer, commandBuffer};
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (transfer) {
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &transferDone;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 2;
+        submitInfo.pCommandBuffers = commandBuffers;
+    } else {
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+    }
+    VK_CHECK(vkQueueSubmit(vk->graphicsQueue, 1, &submitInfo, fence));
+    submitted = true;
+}
+
+void VkUploadBatch::submitAsync() {
+    // release the destinations to graphics, the matching acquires go into acquireCommandBuffer
+    vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+        (uint32_t)releasedBuffers.size(), releasedBuffers.data(), (uint32_t)releasedImages.size(), releasedImages.data());
+    VK_CHECK(vkEndCommandBuffer(transferCommandBuffer));
+    transferRecording = false;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &transferCommandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &transferDone;
+    VK_CHECK(vkQueueSubmit(vk->transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    // same barriers again on the graphics side: same families, ranges and layouts, now with the accesses that read them
+    for (auto &b : releasedBuffers) {
+        b.srcAccessMask = 0;
+        b.dstAccessMask = UPLOAD_CONSUMER_ACCESS | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+    for (auto &b : releasedImages) {
+        b.srcAccessMask = 0;
+        b.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    }
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(acquireCommandBuffer, &beginInfo));
+    vkCmdPipelineBarrier(acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, UPLOAD_CONSUMER_STAGES | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+        (uint32_t)releasedBuffers.size(), releasedBuffers.data(), (uint32_t)releasedImages.size(), releasedImages.data());
+    VK_CHECK(vkEndCommandBuffer(acquireCommandBuffer));
+    releasedBuffers.clear();
+    releasedImages.clear();
+}
+
+bool VkUploadBatch::isComplete() {
+    if (!submitted) {
+        return !recording;
+    }
+    if (vkGetFenceStatus(vk->device, fence) != VK_SUCCESS) {
+        return false;
+    }
+    recycle();
+    return true;
+}
+
+void VkUploadBatch::wait() {
+    if (!submitted) {
+        return;
+    }
+    VK_CHECK(vkWaitForFences(vk->device, 1, &fence, VK_TRUE, UINT64_MAX));
+    recycle();
+}
+
+void VkUploadBatch::recycle() {
+    for (auto &staging : stagingBuffers) {
+        vk->destroyBuffer(staging.buffer, staging.memory);
+    }
+    stagingBuffers.clear();
+    if (ring) {
+        ring->reset(ringRegion); // the copies that read it are done
+    }
+    VK_CHECK(vkResetFences(vk->device, 1, &fence));
+    VK_CHECK(vkResetCommandPool(vk->device, commandPool, 0));
+    if (async) {
+        VK_CHECK(vkResetCommandPool(vk->device, transferPool, 0));
+    }
+    submitted = false;
+    bytesUploaded = 0;
+    copyCount = 0;
+}
+
+void VkHandles::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    VkUploadBatch batch;
+    batch.init(*this);
+    batch.copyBuffer(srcBuffer, dstBuffer, size);
+    batch.submit();
+    batch.wait();
+    batch.destroy();
+}
+
+VkBuffer VkHandles::createVertexBuffer(VkUploadBatch &uploads, std::vector<Vertex> const &vertices, VkBuffer &vertexBuffer, VkAllocation &vertexBufferMemory) {
+    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    uploads.uploadBuffer(vertices.data(), bufferSize, vertexBuffer);
+    return vertexBuffer;
+}
+
+VkUploadBatch &Vulkan::uploads() {
+    VkUploadBatch &batch = *frameUploads[render.currentFrame];
+    batch.wait();
+    return batch;
+}
+
+void Vulkan::recycleFrameUploads() {
+    // the frame's inFlightFence has signaled, so the slot's batch submitted ahead of it is done too.
+    // recycling it hands its staging region back. a batch recorded since (not yet submitted) is left alone
+    frameUploads[render.currentFrame]->wait();
+}
+
+void Vulkan::submitFrameUploads() {
+    frameUploads[render.currentFrame]->submit();
+}
+
+void createFrameUploads(Vulkan &vulkan, VkDeviceSize stagingBytesPerFrame) {
+    vulkan.staging = new VkStagingRing();
+    vulkan.staging->init(vulkan.handles, stagingBytesPerFrame, vulkan.render.framesInFlight);
+    for (uint32_t i = 0; i < vulkan.frameUploads.size(); i++) {
+        // slots past framesInFlight are never recorded, they get no region
+        vulkan.frameUploads[i] = new VkUploadBatch();
+        vulkan.frameUploads[i]->init(vulkan.handles, i < vulkan.render.framesInFlight ? vulkan.staging : nullptr, i);
+    }
+}
+
+void destroyFrameUploads(Vulkan &vulkan) {
+    for (auto &batch : vulkan.frameUploads) {
+        if (batch->recording) {
+            batch->submit(); // so its staging buffers get released by the wait in destroy()
+        }
+        batch->destroy();
+        delete batch;
+        batch = nullptr;
+    }
+    vulkan.staging->destroy(vulkan.handles);
+    delete vulkan.staging;
+    vulkan.staging = nullptr;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "Vulkan.h"
+
+#include <vector>
+
+#define DEFAULT_STAGING_BYTES_PER_FRAME (16 * 1024 * 1024)
+
+// One big persistently mapped staging buffer carved into regions, one per frame upload
+// batch. A region belongs to its batch: it is handed out front to back while the batch
+// records and only reset once the batch's fence has signaled (VkUploadBatch::recycle),
+// so nothing still to be read by the GPU is ever overwritten and streaming uploads never
+// allocate. bytesPerFrame is the per-batch upload budget.
+struct VkStagingRing {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkAllocation memory;
+    VkDeviceSize bytesPerFrame = 0;
+    uint32_t frameCount = 0;
+    std::vector<VkDeviceSize> heads; // next free byte in each region
+
+    // stats
+    VkDeviceSize peakFrameBytes = 0;
+    VkDeviceSize overflowBytes = 0; // staged outside the ring because the region's budget was used up
+
+    void init(VkHandles &vk, VkDeviceSize bytesPerFrame, uint32_t frameCount = MAX_FRAMES_IN_FLIGHT);
+    void destroy(VkHandles &vk);
+    void reset(uint32_t region) { heads[region] = 0; }
+    VkDeviceSize remaining(uint32_t region) const { return bytesPerFrame - heads[region]; }
+    bool alloc(uint32_t region, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset, void *&ptr);
+};
+
+// Collects many buffer/image copies into one command buffer and submits them with a
+// single vkQueueSubmit + fence, instead of a command pool and a queue idle per copy.
+// Usage: record copies, submit(), then poll isComplete() or wait(). Once complete the
+// batch can record again; staging memory it owns is released at that point.
+// Batches given a staging ring stage through their own region of it (ringRegion) and fall
+// back to a one-off staging buffer when the region's budget is exhausted. The region is
+// reset when the batch recycles, i.e. after its fence, never on a frame boundary.
+//
+// On devices with a separate transfer family (VkHandles::asyncTransfer) the staging copies
+// run on the transfer queue, next to whatever graphics is rendering. Their destinations are
+// released to the graphics family at the end and acquired by a small graphics submit that
+// waits on transferDone; the fence goes on that submit. copyBuffer (device to device) stays on
+// graphics, which owns those buffers, after the acquires. So the graphics queue only waits
+// where the uploaded data is first needed. Staging uploads and copyBuffer in one batch must
+// not write overlapping ranges. Buffers created with VkHandles::createSharedBuffer need no
+// ownership transfer: pass shared to uploadBuffer, and copySharedBuffer between them records
+// with the staging copies, so it is ordered with them by transferBarrier() (e.g. MeshArena).
+struct VkUploadBatch {
+    VkHandles *vk = nullptr;
+    VkStagingRing *ring = nullptr;
+    uint32_t ringRegion = 0;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE; // graphics: device copies, or everything without async transfer
+    VkFence fence = VK_NULL_HANDLE;
+    bool recording = false;
+    bool submitted = false;
+
+    // async transfer only
+    bool async = false;
+    VkCommandPool transferPool = VK_NULL_HANDLE;
+    VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE; // staging copies + release barriers
+    VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;  // graphics side acquire barriers, runs before commandBuffer
+    VkSemaphore transferDone = VK_NULL_HANDLE;
+    bool transferRecording = false;
+    std::vector<VkBufferMemoryBarrier> releasedBuffers;
+    std::vector<VkImageMemoryBarrier> releasedImages;
+
+    struct StagingBuffer {
+        VkBuffer buffer;
+        VkAllocation memory;
+    };
+    std::vector<StagingBuffer> stagingBuffers; // staging and retired buffers, released once the batch completes
+
+    // stats for the batch currently being recorded
+    VkDeviceSize bytesUploaded = 0;
+    uint32_t copyCount = 0;
+
+    void init(VkHandles &vk, VkStagingRing *ring = nullptr, uint32_t ringRegion = 0);
+    void destroy();
+
+    // between device resources, always on the graphics queue
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+    // transitions the whole image UNDEFINED -> TRANSFER_DST -> finalLayout around the copy. srcBuffer must be a staging buffer
+    void copyBufferToImage(VkBuffer srcBuffer, VkImage dstImage, VkExtent3D extent, VkImageLayout finalLayout, VkDeviceSize srcOffset = 0);
+
+    // between shared buffers (VkHandles::createSharedBuffer), on the same queue as the staging copies
+    void copySharedBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+
+    // stage host data and copy it into dstBuffer. shared: dstBuffer came from createSharedBuffer, no ownership transfer
+    void uploadBuffer(void const *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0, bool shared = false);
+    void uploadImage(void const *data, VkDeviceSize size, VkImage dstImage, VkExtent3D extent, VkImageLayout finalLayout);
+
+    // builds levels 1..mipLevels-1 of an image from level 0 with linear blits on the graphics queue, then moves every
+    // level to SHADER_READ_ONLY_OPTIMAL. level 0 must have been copied with finalLayout TRANSFER_DST_OPTIMAL in this batch.
+    // the format needs blit src/dst and linear filter support in optimal tiling
+    void generateMipmaps(VkImage image, VkExtent3D extent, uint32_t mipLevels);
+
+    // orders copies recorded so far before the ones recorded next, needed when a later copy reads what an earlier one wrote
+    void transferBarrier();
+
+    // destroy a buffer once this batch completes, e.g. one replaced by a copy recorded here
+    void retire(VkBuffer buffer, VkAllocation memory) {
+        stagingBuffers.push_back({buffer, memory});
+    }
+
+    void submit();
+    bool isComplete(); // non-blocking
+    void wait();
+
+private:
+    void begin();
+    VkCommandBuffer beginStaging(); // where staging copies go: transferCommandBuffer or commandBuffer
+    void submitAsync();
+    VkDeviceSize stage(void const *data, VkDeviceSize size, VkBuffer &stagingBuffer);
+    void recycle();
+};
+
+// creates Vulkan::staging and the per-frame Vulkan::frameUploads batches that stage through it
+void createFrameUploads(Vulkan &vulkan, VkDeviceSize stagingBytesPerFrame);
+void destroyFrameUploads(Vulkan &vulkan);
@@ -0,0 +1,94 @@
+#include "VertexFormat.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+MeshBounds MeshBounds::of(Vertex const *vertices, size_t count) {
+    MeshBounds bounds;
+    if (count == 0) {
+        return bounds;
+    }
+    glm::vec3 lo = vertices[0].pos, hi = vertices[0].pos;
+    for (size_t i = 1; i < count; i++) {
+        lo = glm::min(lo, vertices[i].pos);
+        hi = glm::max(hi, vertices[i].pos);
+    }
+    bounds.center = (lo + hi) * 0.5f;
+    bounds.halfExtent = (hi - lo) * 0.5f;
+    return bounds;
+}
+
+glm::vec3 MeshBounds::normalize(glm::vec3 position) const {
+    glm::vec3 n;
+    for (int i = 0; i < 3; i++) {
+        // flat axes (a quad's z) collapse onto the center
+        n[i] = halfExtent[i] > 0.0f ? (position[i] - center[i]) / halfExtent[i] : 0.0f;
+    }
+    return n;
+}
+
+glm::mat4 MeshBounds::dequantize() const {
+    return glm::scale(glm::translate(glm::mat4(1.0f), center), halfExtent);
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0) {
+        // denormal or zero. positions are in [-1, 1] so this is only hit right next to 0
+        if (exponent < -10) {
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+    if (exponent >= 31) {
+        return (uint16_t)(sign | 0x7c00); // inf, nothing we encode should get here
+    }
+
+    // round to nearest even, a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return (uint16_t)(sign | half);
+}
+
+int16_t floatToSnorm16(float value) {
+    return (int16_t)std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+uint8_t floatToUnorm8(float value) {
+    return (uint8_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+void octEncode(glm::vec3 normal, float &u, float &v) {
+    // project onto the octahedron |x|+|y|+|z| = 1, then fold the lower half over the diagonals
+    float l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (l1 == 0.0f) {
+        u = v = 0.0f;
+        return;
+    }
+    u = normal.x / l1;
+    v = normal.y / l1;
+    if (normal.z < 0.0f) {
+        float foldedU = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float foldedV = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = foldedU;
+        v = foldedV;
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "Vulkan.h"
+
+#include <vector>
+
+// Compact vertex layouts assembled at compile time from per-attribute encodings:
+//
+//   using SmallVertex = PackedVertex<PositionSnorm16, ColorUnorm8, NormalOct16>; // 16 bytes
+//
+// Every encoding knows its VkFormat and how to convert from the float data we load, so
+// PackedVertex can generate the binding/attribute descriptions for the pipeline and
+// encodeVertices() converts a mesh on load. Locations match the shaders: 0 position,
+// 1 color, 2 normal. The shaders take vec3/vec4 inputs either way, the fetch unit
+// expands SNORM/UNORM/half formats for free.
+//
+// Quantized positions are stored relative to the mesh's bounding box, mapped to [-1, 1].
+// MeshBounds::dequantize() is the matrix that maps them back, fold it into the model
+// matrix (Model::meshTransform) rather than decoding in the shader.
+
+struct MeshBounds {
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 halfExtent = glm::vec3(1.0f);
+
+    static MeshBounds of(Vertex const *vertices, size_t count);
+    static MeshBounds of(std::vector<Vertex> const &vertices) {
+        return of(vertices.data(), vertices.size());
+    }
+    glm::vec3 normalize(glm::vec3 position) const; // into [-1, 1]
+    glm::mat4 dequantize() const;
+};
+
+uint16_t floatToHalf(float value);
+int16_t floatToSnorm16(float value);
+uint8_t floatToUnorm8(float value);
+void octEncode(glm::vec3 normal, float &u, float &v); // unit vector to [-1, 1]^2
+
+// positions
+struct PositionF32 {
+    glm::vec3 value;
+    static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT;
+    static constexpr bool quantized = false;
+    void encode(glm::vec3 position, MeshBounds const &) { value = position; }
+};
+
+// 3 component 16 bit vertex formats are poorly supported, so these carry a padding w
+struct PositionF16 {
+    uint16_t value[4];
+    static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    static constexpr bool quantized = true;
+    void encode(glm::vec3 position, MeshBounds const &bounds) {
+        glm::vec3 n = bounds.normalize(position);
+        value[0] = floatToHalf(n.x);
+        value[1] = floatToHalf(n.y);
+        value[2] = floatToHalf(n.z);
+        value[3] = floatToHalf(1.0f);
+    }
+};
+
+struct PositionSnorm16 {
+    int16_t value[4];
+    static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SNORM;
+    static constexpr bool quantized = true;
+    void encode(glm::vec3 position, MeshBounds const &bounds) {
+        glm::vec3 n = bounds.normalize(position);
+        value[0] = floatToSnorm16(n.x);
+        value[1] = floatToSnorm16(n.y);
+        value[2] = floatToSnorm16(n.z);
+        value[3] = INT16_MAX;
+    }
+};
+
+// colors
+struct ColorF32 {
+    glm::vec3 value;
+    static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT;
+    void encode(glm::vec3 color) { value = color; }
+};
+
+struct ColorUnorm8 {
+    uint8_t value[4];
+    static constexpr VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    void encode(glm::vec3 color) {
+        value[0] = floatToUnorm8(color.x);
+        value[1] = floatToUnorm8(color.y);
+        value[2] = floatToUnorm8(color.z);
+        value[3] = 255;
+    }
+};
+
+// normals
+struct NoNormal {
+    static constexpr VkFormat format = VK_FORMAT_UNDEFINED;
+    void encode(glm::vec3) {}
+};
+
+struct NormalF32 {
+    glm::vec3 value;
+    static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT;
+    void encode(glm::vec3 normal) { value = normal; }
+};
+
+// octahedral encoding: 4 bytes for a unit vector, decode with the usual octDecode in the shader
+struct NormalOct16 {
+    int16_t value[2];
+    static constexpr VkFormat format = VK_FORMAT_R16G16_SNORM;
+    void encode(glm::vec3 normal) {
+        float u, v;
+        octEncode(normal, u, v);
+        value[0] = floatToSnorm16(u);
+        value[1] = floatToSnorm16(v);
+    }
+};
+
+template <typename Position, typename Color, typename Normal = NoNormal>
+struct PackedVertex {
+    Position position;
+    Color color;
+    [[no_unique_address]] Normal normal;
+
+    static constexpr bool quantizedPosition = Position::quantized;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions = {
+            {0, 0, Position::format, offsetof(PackedVertex, position)},
+            {1, 0, Color::format, offsetof(PackedVertex, color)},
+        };
+        if constexpr (Normal::format != VK_FORMAT_UNDEFINED) {
+            attributeDescriptions.push_back({2, 0, Normal::format, offsetof(PackedVertex, normal)});
+        }
+        return attributeDescriptions;
+    }
+};
+
+// normals are optional, meshes without them get +z
+template <typename V>
+std::vector<V> encodeVertices(Vertex const *vertices, size_t count, MeshBounds const &bounds, glm::vec3 const *normals = nullptr) {
+    std::vector<V> packed(count);
+    for (size_t i = 0; i < count; i++) {
+        packed[i].position.encode(vertices[i].pos, bounds);
+        packed[i].color.encode(vertices[i].color);
+        packed[i].normal.encode(normals ? normals[i] : glm::vec3(0.0f, 0.0f, 1.0f));
+    }
+    return packed;
+}
+
+template <typename V>
+std::vector<V> encodeVertices(std::vector<Vertex> const &vertices, MeshBounds const &bounds, std::vector<glm::vec3> const *normals = nullptr) {
+    return encodeVertices<V>(vertices.data(), vertices.size(), bounds, normals ? normals->data() : nullptr);
+}
+
+// half the size of Vertex, what the app uses by default
+using CompactVertex = PackedVertex<PositionSnorm16, ColorUnorm8>;
+static_assert(sizeof(CompactVertex) * 2 == sizeof(Vertex), "CompactVertex should be half of Vertex");
@@ -1,4 +1,7 @@
 #include "Vulkan.h"
+#include "Upload.h"
+#include "PipelineCache.h"
+#include "Uniforms.h"
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
@@ -16,6 +19,7 @@
 #include <array>
 #include <optional>
 #include <set>
+#include <chrono>
 
 
 struct SwapChainSupportDetails {
@@ -49,23 +53,32 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
     }
 }
 
+// not every platform reports a resize through acquire/present, the callback catches the rest.
+// a file static because the Vulkan struct is returned by value and there is only ever the one window
+static bool framebufferResized = false;
+
+static void framebufferResizeCallback(GLFWwindow*, int, int) {
+    framebufferResized = true;
+}
+
 GLFWwindow* initWindow(int WIDTH, int HEIGHT) {
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
     GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-    //glfwSetWindowUserPointer(window, this);
-    //glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
     return window;
 }
 
-std::vector<const char*> getRequiredExtensions(bool enableValidationLayers) {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+std::vector<const char*> getRequiredExtensions(bool enableValidationLayers, bool headless) {
+    std::vector<const char*> extensions;
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -88,20 +101,20 @@ static void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT&
     createInfo.pfnUserCallback = debugCallback;
 }
 
-static VkInstance createInstance(bool enableValidationLayers, char const * applicationName = "VulkanApp") {
+static VkInstance createInstance(bool enableValidationLayers, char const * applicationName = "VulkanApp", bool headless = false) {
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     appInfo.pApplicationName = applicationName;
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_2; // devices below 1.2 still work, they just get fence frame sync
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
 
-    auto extensions = getRequiredExtensions(enableValidationLayers);
+    auto extensions = getRequiredExtensions(enableValidationLayers, headless);
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
     createInfo.ppEnabledExtensionNames = extensions.data();
 
@@ -152,7 +165,12 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surfa
         }
 
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        if (surface == VK_NULL_HANDLE) {
+            // headless: nothing is presented, the graphics queue stands in for present
+            presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        } else {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        }
 
         if (presentSupport) {
             indices.presentFamily = i;
@@ -165,6 +183,31 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surfa
         i++;
     }
 
+    // a copy engine that runs next to graphics: transfer-only (dma) if there is one, else any non-graphics family.
+    // compute families can always transfer, even when they don't set the bit
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if (flags & VK_QUEUE_GRAPHICS_BIT || !(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            continue;
+        }
+        bool transferOnly = !(flags & VK_QUEUE_COMPUTE_BIT);
+        if (!indices.transferFamily || transferOnly) {
+            indices.transferFamily = family;
+        }
+        if (transferOnly) {
+            break;
+        }
+    }
+
+    // async compute: the first compute family without graphics. may be the same family uploads picked
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if (flags & VK_QUEUE_COMPUTE_BIT && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            indices.computeFamily = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -210,6 +253,10 @@ static SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physicalDe
 
 static bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
     QueueFamilyIndices indices = findQueueFamilies(device, surface);
+    if (surface == VK_NULL_HANDLE) {
+        // headless devices only need to render, no swapchain support required
+        return indices.isComplete();
+    }
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
@@ -247,11 +294,32 @@ VkPhysicalDevice pickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface) {
     return physicalDevice;
 }
 
-VkDevice createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, bool enableValidationLayers, VkQueue& graphicsQueue, VkQueue& presentQueue) {
+static bool hasDeviceExtension(VkPhysicalDevice device, char const *name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// also enables the optional features/extensions the device has and records them in vk
+VkDevice createLogicalDevice(VkHandles &vk, bool enableValidationLayers) {
+    VkPhysicalDevice physicalDevice = vk.physicalDevice;
+    VkSurfaceKHR surface = vk.surface;
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice, surface);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    vk.graphicsFamily = indices.graphicsFamily.value();
+    vk.transferFamily = indices.transferFamily.value_or(vk.graphicsFamily);
+    vk.computeFamily = indices.computeFamily.value_or(vk.graphicsFamily);
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(), vk.transferFamily, vk.computeFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -263,7 +331,16 @@ VkDevice createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfa
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    vk.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    vk.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    vk.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -273,8 +350,38 @@ VkDevice createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfa
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // timeline semaphores for frame sync, core since 1.2. everything else still runs on a 1.0 device
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceVulkan12Features supported12{};
+        supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures2{};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supported12;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+        features12.timelineSemaphore = supported12.timelineSemaphore;
+        // with Vulkan12Features chained it has to say so too, the extension alone doesn't count (VUID 04476)
+        features12.drawIndirectCount = supported12.drawIndirectCount;
+        createInfo.pNext = &features12;
+    }
+    vk.timelineSemaphores = features12.timelineSemaphore;
+
+    // VK_KHR_swapchain is only needed when there is a surface to present to
+    std::vector<const char*> extensions;
+    if (surface != VK_NULL_HANDLE) {
+        extensions = deviceExtensions;
+    }
+    // core in 1.2, the extension before that
+    bool coreDrawIndirectCount = features12.drawIndirectCount == VK_TRUE;
+    bool drawIndirectCount = coreDrawIndirectCount || hasDeviceExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (drawIndirectCount && !coreDrawIndirectCount) {
+        extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -288,8 +395,13 @@ VkDevice createLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfa
         throw std::runtime_error("failed to create logical device!");
     }
 
-    vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &vk.graphicsQueue);
+    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &vk.presentQueue);
+    vkGetDeviceQueue(device, vk.transferFamily, 0, &vk.transferQueue);
+    vkGetDeviceQueue(device, vk.computeFamily, 0, &vk.computeQueue);
+    if (drawIndirectCount) {
+        vk.cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(device, coreDrawIndirectCount ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirectCountKHR");
+    }
     return device;
 }
 
@@ -302,16 +414,61 @@ static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFor
     return availableFormats[0];
 }
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-    for (const auto& availablePresentMode : availablePresentModes) {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return availablePresentMode;
+// first of the config's modes the surface supports, FIFO is the one every surface has
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, std::vector<VkPresentModeKHR> const &preferredModes) {
+    for (auto preferred : preferredModes) {
+        for (const auto& availablePresentMode : availablePresentModes) {
+            if (availablePresentMode == preferred) {
+                return availablePresentMode;
+            }
         }
     }
 
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+char const *presentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+    default: return "other";
+    }
+}
+
+VkPresentConfig VkPresentConfig::lowLatency() {
+    VkPresentConfig config;
+    config.name = "low-latency";
+    config.framesInFlight = 1;
+    config.presentModes = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+    return config;
+}
+
+VkPresentConfig VkPresentConfig::balanced() {
+    return VkPresentConfig();
+}
+
+VkPresentConfig VkPresentConfig::throughput() {
+    VkPresentConfig config;
+    config.name = "throughput";
+    config.framesInFlight = 3;
+    config.swapChainImages = 3;
+    config.presentModes = {VK_PRESENT_MODE_FIFO_KHR};
+    return config;
+}
+
+VkPresentConfig VkPresentConfig::named(std::string const &name) {
+    if (name == "low-latency") {
+        return lowLatency();
+    } else if (name == "balanced") {
+        return balanced();
+    } else if (name == "throughput") {
+        return throughput();
+    }
+    throw std::runtime_error("unknown present profile '" + name + "', expected low-latency, balanced or throughput");
+}
+
 VkExtent2D chooseSwapExtent(GLFWwindow* window, const VkSurfaceCapabilitiesKHR& capabilities) {
     if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
         return capabilities.currentExtent;
@@ -331,14 +488,17 @@ VkExtent2D chooseSwapExtent(GLFWwindow* window, const VkSurfaceCapabilitiesKHR&
     }
 }
 
-static void createSwapChain(VkHandles &vk, VkPresent &present) {
+static void createSwapChain(VkHandles &vk, VkPresent &present, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(vk.physicalDevice, vk.surface);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes, present.config.presentModes);
     VkExtent2D extent = chooseSwapExtent(vk.window, swapChainSupport.capabilities);
 
     uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    if (present.config.swapChainImages > 0) {
+        imageCount = std::max(present.config.swapChainImages, swapChainSupport.capabilities.minImageCount);
+    }
     if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
         imageCount = swapChainSupport.capabilities.maxImageCount;
     }
@@ -369,6 +529,7 @@ static void createSwapChain(VkHandles &vk, VkPresent &present) {
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = oldSwapChain; // lets the driver hand over its images without a gap on screen
 
     if (vkCreateSwapchainKHR(vk.device, &createInfo, nullptr, &present.swapChain) != VK_SUCCESS) {
         throw std::runtime_error("failed to create swap chain!");
@@ -380,6 +541,44 @@ static void createSwapChain(VkHandles &vk, VkPresent &present) {
 
     present.swapChainImageFormat = surfaceFormat.format;
     present.swapChainExtent = extent;
+    present.presentMode = presentMode;
+}
+
+// headless stand-in for createSwapChain + createImageViews: one device owned color image per frame in flight
+static void createOffscreenImages(VkHandles &vk, VkPresent &p, VkExtent2D extent) {
+    p.swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    p.swapChainExtent = extent;
+    p.offscreenImages.resize(p.config.framesInFlight);
+
+    for (auto &target : p.offscreenImages) {
+        VkImageCreateInfo imageCI{};
+        imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCI.imageType = VK_IMAGE_TYPE_2D;
+        imageCI.format = p.swapChainImageFormat;
+        imageCI.extent = { extent.width, extent.height, 1 };
+        imageCI.mipLevels = 1;
+        imageCI.arrayLayers = 1;
+        imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vk.createImage(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image, target.mem);
+
+        VkImageViewCreateInfo viewCI{};
+        viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewCI.image = target.image;
+        viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewCI.format = p.swapChainImageFormat;
+        viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewCI.subresourceRange.baseMipLevel = 0;
+        viewCI.subresourceRange.levelCount = 1;
+        viewCI.subresourceRange.baseArrayLayer = 0;
+        viewCI.subresourceRange.layerCount = 1;
+        VK_CHECK(vkCreateImageView(vk.device, &viewCI, nullptr, &target.view));
+
+        p.swapChainImages.push_back(target.image);
+        p.swapChainImageViews.push_back(target.view);
+    }
 }
 
 static void createImageViews(VkHandles &vk, VkPresent &p) {
@@ -416,7 +615,8 @@ static void createRenderPass(VkHandles &vk, VkPresent &p, VkRender &r) {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // headless targets are never presented, leave them ready to be copied out instead
+    colorAttachment.finalLayout = vk.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -497,12 +697,75 @@ static VkShaderModule createShaderModule(VkHandles &vk, const std::vector<char>&
     return shaderModule;
 }
 
-static void createGraphicsPipeline(VkHandles &vk, VkPresent &p, VkRender &r, char const *vertexShader, char const *fragmentShader) {
-    auto vertShaderCode = readFile(vertexShader);
-    auto fragShaderCode = readFile(fragmentShader);
+VkShaderModule loadShaderModule(VkHandles &vk, char const *path) {
+    return vk.shaderModules->get(vk, path);
+}
 
-    VkShaderModule vertShaderModule = createShaderModule(vk, vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(vk, fragShaderCode);
+VkShaderModule VkShaderModuleCache::get(VkHandles &vk, std::string const &path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = modules.find(path);
+        if (it != modules.end()) {
+            hits++;
+            return it->second;
+        }
+    }
+    // file io and module creation outside the lock, other paths keep going meanwhile
+    VkShaderModule module = createShaderModule(vk, readFile(path));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto inserted = modules.emplace(path, module);
+    if (!inserted.second) {
+        vkDestroyShaderModule(vk.device, module, nullptr);
+        hits++;
+    } else {
+        loads++;
+    }
+    return inserted.first->second;
+}
+
+void VkShaderModuleCache::destroy(VkDevice device) {
+    for (auto &entry : modules) {
+        vkDestroyShaderModule(device, entry.second, nullptr);
+    }
+    modules.clear();
+}
+
+static void createPipelineLayout(VkHandles &vk, VkRender &r) {
+    VkDescriptorSetLayoutBinding uniformBinding{};
+    uniformBinding.binding = 0;
+    uniformBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uniformBinding.descriptorCount = 1;
+    uniformBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = 1;
+    setLayoutInfo.pBindings = &uniformBinding;
+    VK_CHECK(vkCreateDescriptorSetLayout(vk.device, &setLayoutInfo, nullptr, &r.descriptorSetLayout));
+
+    // per draw model matrix, 64 bytes is well inside the guaranteed 128
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &r.descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(vk.device, &pipelineLayoutInfo, nullptr, &r.pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+}
+
+// every pipeline shares the render pass and fixed function state, they only differ in shaders, vertex input and sometimes layout
+static VkPipeline createPipeline(VkHandles &vk, VkRender &r, VkPipelineLayout layout, char const *vertexShader, char const *fragmentShader, VkPipelineVertexInputStateCreateInfo const &vertexInputInfo, double &createMs) {
+    VkShaderModule vertShaderModule = loadShaderModule(vk, vertexShader);
+    VkShaderModule fragShaderModule = loadShaderModule(vk, fragmentShader);
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -518,17 +781,6 @@ static void createGraphicsPipeline(VkHandles &vk, VkPresent &p, VkRender &r, cha
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -578,15 +830,6 @@ static void createGraphicsPipeline(VkHandles &vk, VkPresent &p, VkRender &r, cha
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-
-    if (vkCreatePipelineLayout(vk.device, &pipelineLayoutInfo, nullptr, &r.pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
     // Depth and stencil state containing depth and stencil compare and test operations
     // We only use depth tests and want depth tests and writes to be enabled and compare with less or equal
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCI{};
@@ -613,15 +856,65 @@ static void createGraphicsPipeline(VkHandles &vk, VkPresent &p, VkRender &r, cha
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = r.pipelineLayout;
+    pipelineInfo.layout = layout;
     pipelineInfo.renderPass = r.renderPass;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    VK_CHECK(vkCreateGraphicsPipelines(vk.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &r.graphicsPipeline));
+    VkPipeline pipeline;
+    auto start = std::chrono::high_resolution_clock::now();
+    VK_CHECK(vkCreateGraphicsPipelines(vk.device, vk.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    createMs = elapsed.count();
+    std::cout << vertexShader << " pipeline created in " << elapsed.count() << " ms (pipeline cache " << (vk.pipelineCacheHit ? "hit" : "miss") << ")\n";
+    return pipeline;
+}
+
+static void createGraphicsPipeline(VkHandles &vk, VkPresent &p, VkRender &r, char const *vertexShader, char const *fragmentShader) {
+    createPipelineLayout(vk, r);
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(r.vertexLayout.attributes.size());
+    vertexInputInfo.pVertexBindingDescriptions = &r.vertexLayout.binding;
+    vertexInputInfo.pVertexAttributeDescriptions = r.vertexLayout.attributes.data();
+
+    r.graphicsPipeline = createPipeline(vk, r, r.pipelineLayout, vertexShader, fragmentShader, vertexInputInfo, r.pipelineCreateMs);
+}
+
+VkPipeline createPipelineWithLayout(Vulkan &vulkan, VkPipelineLayout layout, char const *vertexShader, char const *fragmentShader) {
+    VkRender &r = vulkan.render;
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(r.vertexLayout.attributes.size());
+    vertexInputInfo.pVertexBindingDescriptions = &r.vertexLayout.binding;
+    vertexInputInfo.pVertexAttributeDescriptions = r.vertexLayout.attributes.data();
 
-    vkDestroyShaderModule(vk.device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(vk.device, vertShaderModule, nullptr);
+    double createMs;
+    return createPipeline(vulkan.handles, r, layout, vertexShader, fragmentShader, vertexInputInfo, createMs);
+}
+
+void createInstancedPipeline(Vulkan &vulkan, char const *vertexShader, char const *fragmentShader) {
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VertexLayout const &vertexLayout = vulkan.render.vertexLayout;
+    std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {vertexLayout.binding, InstanceData::getBindingDescription()};
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions = vertexLayout.attributes;
+    for (auto &attribute : InstanceData::getAttributeDescriptions()) {
+        attributeDescriptions.push_back(attribute);
+    }
+
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+    double createMs;
+    vulkan.render.instancedPipeline = createPipeline(vulkan.handles, vulkan.render, vulkan.render.pipelineLayout, vertexShader, fragmentShader, vertexInputInfo, createMs);
 }
 
 // This function is used to request a device memory type that supports all the property flags we request (e.g. device local, host visible)
@@ -661,17 +954,9 @@ void setupDepthStencil(VkHandles &h, VkPresent &p, VkRender &r) {
     imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    VK_CHECK(vkCreateImage(h.device, &imageCI, nullptr, &r.depthStencil.image));
-
-    // Allocate memory for the image (device local) and bind it to our image
-    VkMemoryAllocateInfo memAlloc{};
-    memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(h.device, r.depthStencil.image, &memReqs);
-    memAlloc.allocationSize = memReqs.size;
-    memAlloc.memoryTypeIndex = getMemoryTypeIndex(h, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK(vkAllocateMemory(h.device, &memAlloc, nullptr, &r.depthStencil.mem));
-    VK_CHECK(vkBindImageMemory(h.device, r.depthStencil.image, r.depthStencil.mem, 0));
+
+    // Sub-allocate device local memory for the image from the pooled allocator and bind it
+    h.createImage(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, r.depthStencil.image, r.depthStencil.mem);
 
     // Create a view for the depth stencil image
     // Images aren't directly accessed in Vulkan, but rather through views described by a subresource range
@@ -754,6 +1039,20 @@ void createSyncObjects(VkHandles &vk, VkRender &r) {
     }
 }
 
+static void createFrameTimeline(Vulkan &vulkan) {
+    if (!vulkan.present.config.timelineSync || !vulkan.handles.timelineSemaphores) {
+        return;
+    }
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    VK_CHECK(vkCreateSemaphore(vulkan.handles.device, &semaphoreInfo, nullptr, &vulkan.frameTimeline));
+}
+
 VkFormat getSupportedDepthFormat(VkPhysicalDevice physicalDevice) {
     // Since all depth formats may be optional, we need to find a suitable depth format to use
     // Start with the highest precision packed format
@@ -778,36 +1077,55 @@ VkFormat getSupportedDepthFormat(VkPhysicalDevice physicalDevice) {
     throw std::runtime_error("Could not find a matching depth format");
 }
 
-static VkHandles createVulkanHandles(char const *applicationName, bool enableValidationLayers) {
+static VkHandles createVulkanHandles(char const *applicationName, bool enableValidationLayers, bool headless) {
     VkHandles vk;
-    vk.window = initWindow(800, 600);
-    vk.instance = createInstance(enableValidationLayers, applicationName);
+    vk.headless = headless;
+    if (!headless) {
+        vk.window = initWindow(800, 600);
+    }
+    vk.instance = createInstance(enableValidationLayers, applicationName, headless);
     if (enableValidationLayers) {
         vk.debugMessenger = setupDebugMessenger(vk.instance);
     }
     // make the surface
-    if (glfwCreateWindowSurface(vk.instance, vk.window, nullptr, &vk.surface) != VK_SUCCESS) {
+    if (headless) {
+        vk.surface = VK_NULL_HANDLE;
+    } else if (glfwCreateWindowSurface(vk.instance, vk.window, nullptr, &vk.surface) != VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface!");
     }
     vk.physicalDevice = pickPhysicalDevice(vk.instance, vk.surface);
-    vk.device = createLogicalDevice(vk.physicalDevice, vk.surface, enableValidationLayers, vk.graphicsQueue, vk.presentQueue);
+    vk.device = createLogicalDevice(vk, enableValidationLayers);
+    loadPipelineCache(vk, DEFAULT_PIPELINE_CACHE_PATH);
 
     // misc info
     vkGetPhysicalDeviceMemoryProperties(vk.physicalDevice, &vk.deviceMemoryProperties);
     vk.depthFormat = getSupportedDepthFormat(vk.physicalDevice);
 
+    vk.allocator = new VkAllocator();
+    vk.allocator->init(vk.device, vk.physicalDevice);
+    vk.shaderModules = new VkShaderModuleCache();
+
     return vk;
 }
 
-static VkPresent createVulkanPresent(VkHandles &vk) {
+static void checkPresentConfig(VkPresentConfig const &config) {
+    if (config.framesInFlight < 1 || config.framesInFlight > MAX_FRAMES_IN_FLIGHT) {
+        throw std::runtime_error("framesInFlight must be 1.." + std::to_string(MAX_FRAMES_IN_FLIGHT) + ", got " + std::to_string(config.framesInFlight));
+    }
+}
+
+static VkPresent createVulkanPresent(VkHandles &vk, VkPresentConfig const &config) {
     VkPresent present;
+    present.config = config;
     createSwapChain(vk, present); 
     createImageViews(vk, present);
     return present;
 }
 
-static VkRender createVulkanRender(VkHandles &vk, VkPresent &p, char const *vertexShader, char const *fragmentShader) {
+static VkRender createVulkanRender(VkHandles &vk, VkPresent &p, char const *vertexShader, char const *fragmentShader, VertexLayout const &vertexLayout) {
     VkRender render;
+    render.vertexLayout = vertexLayout;
+    render.framesInFlight = p.config.framesInFlight;
     createRenderPass(vk, p, render);
     createGraphicsPipeline(vk, p, render, vertexShader, fragmentShader);
     setupDepthStencil(vk, p, render);
@@ -819,23 +1137,234 @@ static VkRender createVulkanRender(VkHandles &vk, VkPresent &p, char const *vert
     return render;
 }
 
-Vulkan createVulkan(char const * applicationName, bool enableValidationLayers, char const *vertexShader, char const *fragmentShader) {
-    Vulkan vulkan;
-    vulkan.handles = createVulkanHandles(applicationName, enableValidationLayers);
-    vulkan.present = createVulkanPresent(vulkan.handles);
-    vulkan.render = createVulkanRender(vulkan.handles, vulkan.present, vertexShader, fragmentShader);
-    return vulkan;
+void createVulkan(Vulkan &vulkan, char const * applicationName, bool enableValidationLayers, char const *vertexShader, char const *fragmentShader, VertexLayout const &vertexLayout, VkPresentConfig const &presentConfig) {
+    checkPresentConfig(presentConfig);
+    vulkan.handles = createVulkanHandles(applicationName, enableValidationLayers, false);
+    vulkan.present = createVulkanPresent(vulkan.handles, presentConfig);
+    vulkan.render = createVulkanRender(vulkan.handles, vulkan.present, vertexShader, fragmentShader, vertexLayout);
+    createFrameTimeline(vulkan);
+    createFrameUploads(vulkan, DEFAULT_STAGING_BYTES_PER_FRAME);
+    createUniformRing(vulkan, DEFAULT_UNIFORM_BYTES_PER_FRAME);
+}
+
+void createVulkanHeadless(Vulkan &vulkan, char const * applicationName, bool enableValidationLayers, char const *vertexShader, char const *fragmentShader, uint32_t width, uint32_t height, VertexLayout const &vertexLayout, VkPresentConfig const &presentConfig) {
+    checkPresentConfig(presentConfig);
+    vulkan.handles = createVulkanHandles(applicationName, enableValidationLayers, true);
+    vulkan.present.config = presentConfig; // only framesInFlight matters without a swapchain
+    createOffscreenImages(vulkan.handles, vulkan.present, {width, height});
+    vulkan.render = createVulkanRender(vulkan.handles, vulkan.present, vertexShader, fragmentShader, vertexLayout);
+    createFrameTimeline(vulkan);
+    createFrameUploads(vulkan, DEFAULT_STAGING_BYTES_PER_FRAME);
+    createUniformRing(vulkan, DEFAULT_UNIFORM_BYTES_PER_FRAME);
+}
+
+void Vulkan::recreateSwapChain() {
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(handles.window, &width, &height);
+    while (width == 0 || height == 0) {
+        // minimized, there is nothing to present to until it comes back
+        glfwWaitEvents();
+        glfwGetFramebufferSize(handles.window, &width, &height);
+    }
+    framebufferResized = false;
+    swapChainOutOfDate = false;
+
+    // no vkDeviceWaitIdle: the old resources go to the retire list, frames in flight keep rendering into them
+    retiredSwapchains.push_back({present.swapChain, present.swapChainImageViews, render.swapChainFramebuffers, render.depthStencil, frameNumber});
+    VkFormat format = present.swapChainImageFormat;
+    createSwapChain(handles, present, present.swapChain);
+    if (present.swapChainImageFormat != format) {
+        throw std::runtime_error("swapchain format changed, the render pass would have to be recreated");
+    }
+    createImageViews(handles, present);
+    setupDepthStencil(handles, present, render);
+    createFramebuffers(handles, present, render.depthStencil, render);
+    swapChainRecreations++;
+}
+
+void Vulkan::destroyRetiredSwapchains(bool all) {
+    // frames before retiredAtFrame used it. the presentation engine can still be reading
+    // its last image, vkDestroySwapchainKHR takes care of that
+    uint64_t completed = completedFrames();
+    auto done = [&](VkRetiredSwapchain const &retired) {
+        return all || completed >= retired.retiredAtFrame;
+    };
+    for (auto &retired : retiredSwapchains) {
+        if (!done(retired)) {
+            continue;
+        }
+        for (auto framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(handles.device, framebuffer, nullptr);
+        }
+        for (auto view : retired.imageViews) {
+            vkDestroyImageView(handles.device, view, nullptr);
+        }
+        vkDestroyImageView(handles.device, retired.depthStencil.view, nullptr);
+        handles.destroyImage(retired.depthStencil.image, retired.depthStencil.mem);
+        vkDestroySwapchainKHR(handles.device, retired.swapChain, nullptr);
+    }
+    retiredSwapchains.erase(std::remove_if(retiredSwapchains.begin(), retiredSwapchains.end(), done), retiredSwapchains.end());
+}
+
+uint64_t Vulkan::completedFrames() {
+    if (frameTimeline == VK_NULL_HANDLE) {
+        return knownCompletedFrames;
+    }
+    uint64_t value;
+    VK_CHECK(vkGetSemaphoreCounterValue(handles.device, frameTimeline, &value));
+    return value;
+}
+
+void Vulkan::waitForFrames(uint64_t count) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline;
+    waitInfo.pValues = &count;
+    VK_CHECK(vkWaitSemaphores(handles.device, &waitInfo, UINT64_MAX));
+}
+
+uint32_t Vulkan::acquireNextImage(VkSemaphore imageAvailable) {
+    if (swapChainOutOfDate || framebufferResized) {
+        recreateSwapChain();
+    }
+    uint32_t imageIndex;
+    VkResult acquired;
+    while ((acquired = vkAcquireNextImageKHR(handles.device, present.swapChain, UINT64_MAX, imageAvailable, VK_NULL_HANDLE, &imageIndex)) == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreateSwapChain(); // nothing was signaled, try again on the new one
+    }
+    if (acquired == VK_SUBOPTIMAL_KHR) {
+        swapChainOutOfDate = true; // the image is still usable, draw this frame and rebuild before the next
+    } else {
+        VK_CHECK(acquired);
+    }
+    return imageIndex;
+}
+
+void destroyVulkan(Vulkan &vulkan) {
+    VkHandles &vk = vulkan.handles;
+    VkPresent &p = vulkan.present;
+    VkRender &r = vulkan.render;
+    vkDeviceWaitIdle(vk.device);
+
+    destroyFrameUploads(vulkan);
+    destroyUniformRing(vulkan);
+    vulkan.destroyRetiredSwapchains(true);
+    if (vulkan.frameTimeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(vk.device, vulkan.frameTimeline, nullptr);
+    }
+
+    for (auto &frame : r.frames) {
+        vkDestroySemaphore(vk.device, frame.imageAvailableSemaphore, nullptr);
+        vkDestroySemaphore(vk.device, frame.renderFinishedSemaphore, nullptr);
+        vkDestroyFence(vk.device, frame.inFlightFence, nullptr);
+    }
+    vkDestroyCommandPool(vk.device, r.commandPool, nullptr);
+    for (auto framebuffer : r.swapChainFramebuffers) {
+        vkDestroyFramebuffer(vk.device, framebuffer, nullptr);
+    }
+    vkDestroyImageView(vk.device, r.depthStencil.view, nullptr);
+    vk.destroyImage(r.depthStencil.image, r.depthStencil.mem);
+    vkDestroyPipeline(vk.device, r.graphicsPipeline, nullptr);
+    if (r.instancedPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(vk.device, r.instancedPipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(vk.device, r.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(vk.device, r.descriptorSetLayout, nullptr);
+    vkDestroyRenderPass(vk.device, r.renderPass, nullptr);
+
+    // headless views are the offscreen images' views
+    for (auto view : p.swapChainImageViews) {
+        vkDestroyImageView(vk.device, view, nullptr);
+    }
+    for (auto &target : p.offscreenImages) {
+        vk.destroyImage(target.image, target.mem);
+    }
+    if (p.swapChain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(vk.device, p.swapChain, nullptr);
+    }
+
+    vkDestroyPipelineCache(vk.device, vk.pipelineCache, nullptr);
+    vk.shaderModules->destroy(vk.device);
+    delete vk.shaderModules;
+    vk.allocator->destroy();
+    delete vk.allocator;
+    vkDestroyDevice(vk.device, nullptr);
+
+    if (vk.debugMessenger != VK_NULL_HANDLE) {
+        DestroyDebugUtilsMessengerEXT(vk.instance, vk.debugMessenger, nullptr);
+    }
+    if (vk.surface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(vk.instance, vk.surface, nullptr);
+    }
+    vkDestroyInstance(vk.instance, nullptr);
+    if (vk.window) {
+        glfwDestroyWindow(vk.window);
+    }
+}
+
+std::vector<uint8_t> readOffscreenImage(Vulkan &vulkan, uint32_t imageIndex) {
+    VkHandles &vk = vulkan.handles;
+    VkExtent2D extent = vulkan.present.swapChainExtent;
+    VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+
+    VkBuffer readbackBuffer;
+    VkAllocation readbackMemory;
+    vk.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackMemory);
+
+    // the render pass leaves the image in TRANSFER_SRC_OPTIMAL, just make sure the frame is done
+    vkQueueWaitIdle(vk.graphicsQueue);
+
+    VkCommandPool commandPool = vk.createCommandPool();
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(vk.device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { extent.width, extent.height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, vulkan.present.offscreenImages[imageIndex].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK(vkQueueSubmit(vk.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+    vkQueueWaitIdle(vk.graphicsQueue);
+
+    std::vector<uint8_t> pixels(size);
+    memcpy(pixels.data(), readbackMemory.mapped, (size_t) size);
+
+    vkFreeCommandBuffers(vk.device, commandPool, 1, &commandBuffer);
+    vkDestroyCommandPool(vk.device, commandPool, nullptr);
+    vk.destroyBuffer(readbackBuffer, readbackMemory);
+    return pixels;
 }
 
 
 
 VkCommandPool VkHandles::createCommandPool() {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice, surface);
+    return createCommandPool(graphicsFamily);
+}
 
+VkCommandPool VkHandles::createCommandPool(uint32_t queueFamilyIndex) {
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
 
     VkCommandPool commandPool;
     if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
@@ -1,13 +1,14 @@
 // TODOS:
 // x multiple models
 // - depth buffer
-// - texture mapping
-// - uniform buffers
-// - push constants
+// x texture mapping
+// x uniform buffers
+// x push constants
 // - MSAA
-// - swapchain recreation
+// x swapchain recreation
 #pragma once
 #include <vulkan/vulkan.h>
+#include "Memory.h"
 
 typedef struct GLFWwindow GLFWwindow;
 #include <glm/glm.hpp>
@@ -18,6 +19,10 @@ typedef struct GLFWwindow GLFWwindow;
 #include <string>
 #include <optional>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
 #define VK_CHECK(call)                                  \
     do {                                                \
@@ -28,11 +33,13 @@ typedef struct GLFWwindow GLFWwindow;
         }                                               \
     } while (0)
 
-#define MAX_FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT 4 // size of the per frame arrays, how many are used is VkPresentConfig::framesInFlight
 
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; // a family without graphics for uploads, transfer-only preferred. unset: uploads go to graphics
+    std::optional<uint32_t> computeFamily;  // compute without graphics, for async compute. unset: dispatches go to graphics
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
@@ -69,22 +76,104 @@ struct Vertex {
     }
 };
 
+// per-instance attributes for the instanced pipeline, read from binding 1 once per instance.
+// the mat4 takes up locations 2-5, one vec4 column each
+struct InstanceData {
+    glm::mat4 transform;
+    glm::vec4 color;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+
+        for (uint32_t column = 0; column < 4; column++) {
+            attributeDescriptions[column].binding = 1;
+            attributeDescriptions[column].location = 2 + column;
+            attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[column].offset = offsetof(InstanceData, transform) + column * sizeof(glm::vec4);
+        }
+
+        attributeDescriptions[4].binding = 1;
+        attributeDescriptions[4].location = 6;
+        attributeDescriptions[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[4].offset = offsetof(InstanceData, color);
+
+        return attributeDescriptions;
+    }
+};
+
+// the vertex input of the graphics pipelines, binding 0. Vertex by default, see VertexFormat.h for packed ones
+struct VertexLayout {
+    VkVertexInputBindingDescription binding;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+    template <typename V>
+    static VertexLayout of() {
+        auto attributes = V::getAttributeDescriptions();
+        return {V::getBindingDescription(), std::vector<VkVertexInputAttributeDescription>(attributes.begin(), attributes.end())};
+    }
+};
+
+struct VkUploadBatch;
+
+// Each SPIR-V file is read and turned into a VkShaderModule once, then shared by every pipeline
+// built from it. Thread safe, VkPipelineCompiler's workers go through it too. Two threads asking
+// for a new path at the same time may both load it, the loser's module is dropped.
+struct VkHandles;
+struct VkShaderModuleCache {
+    std::mutex mutex;
+    std::unordered_map<std::string, VkShaderModule> modules;
+    uint32_t loads = 0;
+    uint32_t hits = 0;
+
+    VkShaderModule get(VkHandles &vk, std::string const &path);
+    void destroy(VkDevice device);
+};
+
 struct VkHandles {
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
+    bool headless = false; // no window/surface/swapchain, see createVulkanHeadless
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
 
     VkDevice device;
     VkQueue graphicsQueue, presentQueue;
-    VkSurfaceKHR surface;
-    VkDebugUtilsMessengerEXT debugMessenger;
+    VkQueue transferQueue;   // graphicsQueue unless the device has a separate transfer family, see VkUploadBatch
+    VkQueue computeQueue;    // graphicsQueue unless the device has a separate compute family, see VkComputeQueue
+    uint32_t graphicsFamily = 0;
+    uint32_t transferFamily = 0;
+    uint32_t computeFamily = 0;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
 
    	VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
     VkFormat depthFormat;
+    VkAllocator *allocator; // every buffer/image allocation goes through here
+    VkShaderModuleCache *shaderModules; // see loadShaderModule
+
+    // optional, enabled at device creation when supported
+    bool multiDrawIndirect = false; // drawCount > 1 per vkCmdDrawIndexedIndirect
+    bool drawIndirectFirstInstance = false;
+    bool pipelineStatisticsQuery = false;
+    bool timelineSemaphores = false; // core in 1.2, see Vulkan::frameTimeline
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr; // VK_KHR_draw_indirect_count
+
+    // see loadPipelineCache/savePipelineCache
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    std::string pipelineCachePath;
+    bool pipelineCacheHit = false;
 
     uint32_t findIdxOfMemory(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+        // cached at device creation, this is on every allocation's path
+        VkPhysicalDeviceMemoryProperties &memProperties = deviceMemoryProperties;
 
         for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
             if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
@@ -95,13 +184,36 @@ struct VkHandles {
         throw std::runtime_error("failed to find suitable memory type!");
     }
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    // sub-allocates from the pooled allocator. host visible memory comes back persistently mapped (VkAllocation::mapped)
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkAllocation& bufferMemory) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createBuffer(bufferInfo, properties, buffer, bufferMemory);
+    }
 
+    // for buffers more than one queue family works on (e.g. written by async compute, read by graphics):
+    // VK_SHARING_MODE_CONCURRENT over all of them, so there is no ownership to transfer. exclusive with one family
+    void createSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkAllocation& bufferMemory) {
+        std::vector<uint32_t> families{graphicsFamily};
+        for (uint32_t family : {transferFamily, computeFamily}) {
+            if (std::find(families.begin(), families.end(), family) == families.end()) {
+                families.push_back(family);
+            }
+        }
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+        bufferInfo.queueFamilyIndexCount = (uint32_t)families.size();
+        bufferInfo.pQueueFamilyIndices = families.data();
+        createBuffer(bufferInfo, properties, buffer, bufferMemory);
+    }
+
+    void createBuffer(VkBufferCreateInfo const &bufferInfo, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkAllocation& bufferMemory) {
         if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to create buffer!");
         }
@@ -109,121 +221,137 @@ struct VkHandles {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findIdxOfMemory(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
-
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+        bufferMemory = allocator->allocate(findIdxOfMemory(memRequirements.memoryTypeBits, properties), memRequirements, true);
+        VK_CHECK(vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset));
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-        VkCommandPool commandPool = createCommandPool();
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer commandBuffer;
-        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-        VkBufferCopy copyRegion{};
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-        vkEndCommandBuffer(commandBuffer);
+    void destroyBuffer(VkBuffer buffer, VkAllocation& bufferMemory) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        allocator->free(bufferMemory);
+    }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    void createImage(VkImageCreateInfo const &imageCI, VkMemoryPropertyFlags properties, VkImage& image, VkAllocation& imageMemory) {
+        VK_CHECK(vkCreateImage(device, &imageCI, nullptr, &image));
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-        vkDestroyCommandPool(device, commandPool, nullptr);
+        bool linear = imageCI.tiling == VK_IMAGE_TILING_LINEAR;
+        imageMemory = allocator->allocate(findIdxOfMemory(memRequirements.memoryTypeBits, properties), memRequirements, linear);
+        VK_CHECK(vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset));
     }
 
-    VkCommandPool createCommandPool();
+    void destroyImage(VkImage image, VkAllocation& imageMemory) {
+        vkDestroyImage(device, image, nullptr);
+        allocator->free(imageMemory);
+    }
 
-    VkBuffer createVertexBuffer(std::vector<Vertex> vertices, VkBuffer &vertexBuffer, VkDeviceMemory &vertexBufferMemory) {
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    // one-off copy that blocks until it's done. bulk uploads should record into a VkUploadBatch instead
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    VkCommandPool createCommandPool(); // for the graphics queue
+    VkCommandPool createCommandPool(uint32_t queueFamilyIndex);
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-            memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+    bool asyncTransfer() const {
+        return transferFamily != graphicsFamily;
+    }
+    bool asyncCompute() const {
+        return computeFamily != graphicsFamily;
+    }
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    // records the upload into 'uploads', the buffer is ready once that batch completes
+    VkBuffer createVertexBuffer(VkUploadBatch &uploads, std::vector<Vertex> const &vertices, VkBuffer &vertexBuffer, VkAllocation &vertexBufferMemory);
+};
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+struct VkImageParts {
+    VkImage image;
+    VkAllocation mem;
+    VkImageView view;
+};
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-        return vertexBuffer;
-    }
+// How far the cpu may run ahead of the gpu and how frames reach the screen. More frames in flight
+// and FIFO keep the gpu fed at the cost of latency, fewer frames and IMMEDIATE/MAILBOX the other
+// way round. Pick one of the profiles (or build one) per deployment; the cpu wait / gpu idle
+// readout (Vulkan::cpuWaitMs, VkGpuProfiler::gpuIdleMs) shows what a profile costs.
+struct VkPresentConfig {
+    std::string name = "balanced";
+    uint32_t framesInFlight = 2;  // 1..MAX_FRAMES_IN_FLIGHT
+    uint32_t swapChainImages = 0; // 0: minImageCount + 1, otherwise clamped to what the surface supports
+    std::vector<VkPresentModeKHR> presentModes = {VK_PRESENT_MODE_MAILBOX_KHR}; // first supported one wins, FIFO if none is
+    bool timelineSync = true;     // sync frames on Vulkan::frameTimeline when the device has timeline semaphores, per frame fences otherwise
+
+    static VkPresentConfig lowLatency(); // IMMEDIATE (may tear) or MAILBOX, 1 frame in flight
+    static VkPresentConfig balanced();   // MAILBOX or FIFO, 2 frames in flight
+    static VkPresentConfig throughput(); // FIFO, 3 frames in flight and 3 images
+    // "low-latency", "balanced" or "throughput", throws for anything else
+    static VkPresentConfig named(std::string const &name);
 };
 
+char const *presentModeName(VkPresentModeKHR mode);
+
 struct VkPresent {
-    VkSwapchainKHR swapChain;
+    VkPresentConfig config;
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // what config.presentModes came down to
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImageView> swapChainImageViews;
+
+    // headless: device owned color targets standing in for the swapchain images
+    std::vector<VkImageParts> offscreenImages;
+    uint32_t nextOffscreenImage = 0;
 };
 
+// "the frame's inFlightFence has signaled" elsewhere means the frame's slot is free again,
+// which with Vulkan::frameTimeline is its wait for frame n - framesInFlight instead
 struct VkFrame {
     VkCommandBuffer commandBuffer;
     VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
-    VkFence inFlightFence;
-};
-
-struct VkImageParts {
-    VkImage image;
-    VkDeviceMemory mem;
-    VkImageView view;
+    VkSemaphore renderFinishedSemaphore; // binary, present can't wait on a timeline
+    VkFence inFlightFence;               // unused with Vulkan::frameTimeline
 };
 
 struct VkRender {
     VkRenderPass renderPass;
-    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout; // set 0: the per-frame uniforms at a dynamic offset, see VkUniformRing
+    VkPipelineLayout pipelineLayout;           // set 0 + DrawPushConstants for the vertex stage
+    VertexLayout vertexLayout;                 // what MeshArena vertices look like to both pipelines
     VkPipeline graphicsPipeline;
+    VkPipeline instancedPipeline = VK_NULL_HANDLE; // see createInstancedPipeline
+    double pipelineCreateMs = 0; // time spent in vkCreateGraphicsPipelines, see pipelineCacheHit
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkImageParts depthStencil;
     VkCommandPool commandPool;
     std::array<VkFrame, MAX_FRAMES_IN_FLIGHT> frames;
+    uint32_t framesInFlight = 2; // VkPresentConfig::framesInFlight, currentFrame cycles through these
     size_t currentFrame = 0;
     VkFrame getCF() {
         return frames[currentFrame];
     }
 
-    VkCommandBuffer beginRenderpass(VkPresent &p, uint32_t frameIdx) {
+    // contents is VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS when the draws are recorded in parallel, see VkParallelRecorder
+    VkCommandBuffer beginRenderpass(VkPresent &p, uint32_t frameIdx, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) {
+        auto commandBuffer = beginCommandBuffer();
+        beginRenderpass(commandBuffer, p, frameIdx, contents);
+        return commandBuffer;
+    }
+
+    // the two halves of the above, for commands that have to go before the render pass (query resets etc.)
+    VkCommandBuffer beginCommandBuffer() {
         auto commandBuffer = getCF().commandBuffer;
-        auto swapChainExtent = p.swapChainExtent;
-        auto framebuffer = swapChainFramebuffers[frameIdx];
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
         if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
             throw std::runtime_error("failed to begin recording command buffer!");
         }
+        return commandBuffer;
+    }
+
+    void beginRenderpass(VkCommandBuffer commandBuffer, VkPresent &p, uint32_t frameIdx, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) {
+        auto swapChainExtent = p.swapChainExtent;
+        auto framebuffer = swapChainFramebuffers[frameIdx];
 
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -239,49 +367,166 @@ struct VkRender {
         renderPassInfo.clearValueCount = clearValues.size();
         renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);  
-        return commandBuffer;      
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
     }
 };
 
 
+// the size dependent part of a replaced swapchain. the frames already in flight may still render
+// into it, so it is destroyed once their fences have signaled instead of waiting for the device to idle
+struct VkRetiredSwapchain {
+    VkSwapchainKHR swapChain;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+    VkImageParts depthStencil;
+    uint64_t retiredAtFrame; // Vulkan::frameNumber when it was replaced, frames before that used it
+};
+
+struct VkStagingRing;
+struct VkUniformRing;
+
 struct Vulkan {
     VkHandles handles;
     VkPresent present;
     VkRender render;
 
+    // the upload batches and the uniform ring keep &handles, so it stays where createVulkan built it
+    Vulkan() = default;
+    Vulkan(Vulkan const &) = delete;
+    Vulkan &operator=(Vulkan const &) = delete;
+
+    VkStagingRing *staging = nullptr;
+    std::array<VkUploadBatch *, MAX_FRAMES_IN_FLIGHT> frameUploads{};
+    VkUniformRing *uniforms = nullptr; // per-frame uniform data, recycled along with the frame
+
+    uint64_t frameNumber = 0;            // frames submitted so far
+    // timeline semaphore sync: frame n signals n + 1 when its work is done, so the value is the number of
+    // completed frames. waits, retirement and other queues' submits all key off it. null: fence sync
+    VkSemaphore frameTimeline = VK_NULL_HANDLE;
+    uint64_t knownCompletedFrames = 0;   // as of the last wait in waitAndPrepForNextFrame
+
+    // extra semaphores the next frame submit waits on, e.g. VkComputeQueue's. cleared by submitAndPresent
+    std::vector<VkSemaphore> frameWaitSemaphores;
+    std::vector<VkPipelineStageFlags> frameWaitStages;
+    void addFrameWait(VkSemaphore semaphore, VkPipelineStageFlags stages) {
+        frameWaitSemaphores.push_back(semaphore);
+        frameWaitStages.push_back(stages);
+    }
+
+    double cpuWaitMs = 0;                // how long the last waitAndPrepForNextFrame blocked on its fence and the acquire
+    bool swapChainOutOfDate = false;     // acquire or present said suboptimal/out of date, rebuilt before the next acquire
+    uint32_t swapChainRecreations = 0;
+    std::vector<VkRetiredSwapchain> retiredSwapchains;
+
+    // upload batch for the frame being recorded. It stages through its own region of the staging ring,
+    // is submitted right before the frame's draws and is known complete once the frame's inFlightFence signals.
+    // Between submitAndPresent and the next waitAndPrepForNextFrame the slot's previous batch may still be in
+    // flight, it is waited for here before anything is recorded over it.
+    VkUploadBatch &uploads();
+    void recycleFrameUploads();
+    void submitFrameUploads();
+    void recycleFrameUniforms();
+
+    // new swapchain (passing the old one as oldSwapchain), image views, depth buffer and framebuffers
+    // for the window's current size. the render pass and pipelines don't depend on the size and are kept
+    void recreateSwapChain();
+    // destroys the retired swapchains no frame in flight can still use, or all of them once the device is idle
+    void destroyRetiredSwapchains(bool all = false);
+    // acquires the next image, recreating the swapchain first when it is out of date or the window was resized
+    uint32_t acquireNextImage(VkSemaphore imageAvailable);
+
+    // frames the gpu has finished, frame n is done once this is > n. read from the timeline right now,
+    // with fences it is only what the last fence wait proved
+    uint64_t completedFrames();
+    // blocks until the first count frames are done, needs frameTimeline
+    void waitForFrames(uint64_t count);
+
     uint32_t waitAndPrepForNextFrame() {
         VkFrame cf = render.getCF();
-        vkWaitForFences(handles.device, 1, &cf.inFlightFence, VK_TRUE, UINT64_MAX);
+        auto waitStart = std::chrono::high_resolution_clock::now();
+        // this frame reuses the slot of frame frameNumber - framesInFlight, that one has to be done
+        uint64_t slotFreeAt = frameNumber >= render.framesInFlight ? frameNumber - render.framesInFlight + 1 : 0;
+        if (frameTimeline) {
+            waitForFrames(slotFreeAt);
+        } else {
+            vkWaitForFences(handles.device, 1, &cf.inFlightFence, VK_TRUE, UINT64_MAX);
+        }
+        knownCompletedFrames = std::max(knownCompletedFrames, slotFreeAt);
+        std::chrono::duration<double, std::milli> waited = std::chrono::high_resolution_clock::now() - waitStart;
+        recycleFrameUploads();
+        recycleFrameUniforms();
+        destroyRetiredSwapchains();
 
         uint32_t imageIndex;
-        VK_CHECK(vkAcquireNextImageKHR(handles.device, present.swapChain, UINT64_MAX, cf.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex));
-        vkResetFences(handles.device, 1, &cf.inFlightFence);
+        if (handles.headless) {
+            imageIndex = present.nextOffscreenImage;
+            present.nextOffscreenImage = (imageIndex + 1) % present.offscreenImages.size();
+            cpuWaitMs = waited.count();
+        } else {
+            auto acquireStart = std::chrono::high_resolution_clock::now();
+            imageIndex = acquireNextImage(cf.imageAvailableSemaphore);
+            std::chrono::duration<double, std::milli> acquired = std::chrono::high_resolution_clock::now() - acquireStart;
+            cpuWaitMs = waited.count() + acquired.count();
+        }
+        if (!frameTimeline) {
+            vkResetFences(handles.device, 1, &cf.inFlightFence);
+        }
         vkResetCommandBuffer(cf.commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
         return imageIndex;
     }
 
     void submitAndPresent(uint32_t imageIndex) {
         VkFrame cf = render.getCF();
+        submitFrameUploads();
+
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = {cf.imageAvailableSemaphore};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        // headless frames have no swapchain image to wait on and nothing to present
+        uint32_t semaphoreCount = handles.headless ? 0 : 1;
+
+        // the swapchain image, then whatever was added with addFrameWait (all binary)
+        if (!handles.headless) {
+            frameWaitSemaphores.insert(frameWaitSemaphores.begin(), cf.imageAvailableSemaphore);
+            frameWaitStages.insert(frameWaitStages.begin(), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        }
+        submitInfo.waitSemaphoreCount = (uint32_t)frameWaitSemaphores.size();
+        submitInfo.pWaitSemaphores = frameWaitSemaphores.data();
+        submitInfo.pWaitDstStageMask = frameWaitStages.data();
 
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &cf.commandBuffer;
 
-        VkSemaphore signalSemaphores[] = {cf.renderFinishedSemaphore};
-        submitInfo.signalSemaphoreCount = 1;
+        // renderFinished for present, plus this frame's value on the timeline
+        VkSemaphore signalSemaphores[] = {cf.renderFinishedSemaphore, frameTimeline};
+        uint64_t signalValues[] = {0, frameNumber + 1};
+        submitInfo.signalSemaphoreCount = semaphoreCount;
         submitInfo.pSignalSemaphores = signalSemaphores;
+        if (handles.headless) {
+            signalSemaphores[0] = frameTimeline;
+            signalValues[0] = frameNumber + 1;
+        }
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        if (frameTimeline) {
+            submitInfo.signalSemaphoreCount = handles.headless ? 1 : 2;
+            timelineInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+            timelineInfo.pSignalSemaphoreValues = signalValues;
+            submitInfo.pNext = &timelineInfo;
+        }
 
-        if (vkQueueSubmit(handles.graphicsQueue, 1, &submitInfo, cf.inFlightFence) != VK_SUCCESS) {
+        if (vkQueueSubmit(handles.graphicsQueue, 1, &submitInfo, frameTimeline ? VK_NULL_HANDLE : cf.inFlightFence) != VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        frameWaitSemaphores.clear();
+        frameWaitStages.clear();
+
+        frameNumber++;
+        if (handles.headless) {
+            render.currentFrame = (render.currentFrame + 1) % render.framesInFlight;
+            return;
+        }
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -295,8 +540,34 @@ struct Vulkan {
 
         presentInfo.pImageIndices = &imageIndex;
 
-        VK_CHECK(vkQueuePresentKHR(handles.presentQueue, &presentInfo));
-        render.currentFrame = (render.currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        // the frame still went to the present queue, the swapchain is rebuilt before the next acquire
+        VkResult presented = vkQueuePresentKHR(handles.presentQueue, &presentInfo);
+        if (presented == VK_SUBOPTIMAL_KHR || presented == VK_ERROR_OUT_OF_DATE_KHR) {
+            swapChainOutOfDate = true;
+        } else {
+            VK_CHECK(presented);
+        }
+        render.currentFrame = (render.currentFrame + 1) % render.framesInFlight;
     }
 };
-Vulkan createVulkan(char const * applicationName, bool enableValidationLayers, char const *vertexShader, char const *fragmentShader);
+// builds into vulkan in place, a default constructed Vulkan that then lives until destroyVulkan
+void createVulkan(Vulkan &vulkan, char const * applicationName, bool enableValidationLayers, char const *vertexShader, char const *fragmentShader, VertexLayout const &vertexLayout = VertexLayout::of<Vertex>(), VkPresentConfig const &presentConfig = VkPresentConfig::balanced());
+
+// No GLFW, no surface and no swapchain: frames render into device owned color images
+// (VkPresent::offscreenImages) so this runs on display-less machines, e.g. with lavapipe.
+void createVulkanHeadless(Vulkan &vulkan, char const * applicationName, bool enableValidationLayers, char const *vertexShader, char const *fragmentShader, uint32_t width = 800, uint32_t height = 600, VertexLayout const &vertexLayout = VertexLayout::of<Vertex>(), VkPresentConfig const &presentConfig = VkPresentConfig::balanced());
+
+// pipeline variant with the per-instance InstanceData binding, same layout and render pass as graphicsPipeline
+void createInstancedPipeline(Vulkan &vulkan, char const *vertexShader, char const *fragmentShader);
+
+// same fixed function state, render pass and vertexLayout as graphicsPipeline but with the caller's layout. caller destroys it
+VkPipeline createPipelineWithLayout(Vulkan &vulkan, VkPipelineLayout layout, char const *vertexShader, char const *fragmentShader);
+
+// the shader module for a .spv file, from vk.shaderModules. shared, destroyVulkan destroys it
+VkShaderModule loadShaderModule(VkHandles &vk, char const *path);
+
+// waits for the device to go idle and destroys everything created by createVulkan/createVulkanHeadless
+void destroyVulkan(Vulkan &vulkan);
+
+// copy a rendered offscreen image back as tightly packed RGBA8 rows. waits for the gpu.
+std::vector<uint8_t> readOffscreenImage(Vulkan &vulkan, uint32_t imageIndex);
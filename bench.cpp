@@ -0,0 +1,340 @@
+// vulkan_bench: headless benchmarks for catching perf regressions per commit.
+// Every measurement is warmed up, repeated and reported as min/p50/avg/p99 in a JSON file.
+//
+//   vulkan_bench [--quick] [--json path] [--warmup n] [--reps n]
+//
+// --quick runs fewer repetitions and skips the 100k model scenes, it's what ctest runs.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Vulkan.h"
+#include "Upload.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "Record.h"
+#include "Profiler.h"
+#include "ObjLoader.h"
+#include "MeshCache.h"
+#include "Culling.h"
+
+#define BENCH_VERT_SHADER "shaders/vert/passthru.spv"
+#define BENCH_FRAG_SHADER "shaders/frag/passthru.spv"
+#define BENCH_INDIRECT_VERT_SHADER "shaders/vert/indirect.spv"
+
+// s as a quoted JSON string. device names and result names come from drivers and files, so anything can be in them
+static std::string jsonString(std::string const &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+struct BenchResult {
+    std::string name;
+    std::string unit;
+    RollingStats::Summary summary;
+};
+
+struct Bench {
+    uint32_t warmup = 10;
+    uint32_t reps = 100;
+    std::vector<BenchResult> results;
+
+    // runs 'run' warmup + reps times, each call returns its own sample (ms, MB/s, ...)
+    void measure(std::string const &name, std::string const &unit, std::function<double()> const &run) {
+        for (uint32_t i = 0; i < warmup; i++) {
+            run();
+        }
+        RollingStats stats;
+        stats.window = reps;
+        for (uint32_t i = 0; i < reps; i++) {
+            stats.add(run());
+        }
+        add(name, unit, stats);
+    }
+
+    void add(std::string const &name, std::string const &unit, RollingStats const &stats) {
+        BenchResult result{name, unit, stats.summary()};
+        std::cout << name << ": min " << result.summary.min << " p50 " << result.summary.p50 << " avg " << result.summary.avg << " p99 " << result.summary.p99 << " " << unit << "\n";
+        results.push_back(result);
+    }
+
+    void writeJson(char const *path, char const *deviceName) {
+        std::ofstream out(path);
+        out << "{\n  \"device\": " << jsonString(deviceName) << ",\n  \"warmup\": " << warmup << ",\n  \"repetitions\": " << reps << ",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            auto &r = results[i];
+            out << "    {\"name\": " << jsonString(r.name) << ", \"unit\": " << jsonString(r.unit) << ", \"min\": " << r.summary.min << ", \"p50\": " << r.summary.p50
+                << ", \"avg\": " << r.summary.avg << ", \"p99\": " << r.summary.p99 << ", \"samples\": " << r.summary.samples << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+};
+
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// side x side vertex grid, two triangles per cell
+static void makeGrid(uint32_t side, float size, std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+    vertices.clear();
+    indices.clear();
+    for (uint32_t y = 0; y < side; y++) {
+        for (uint32_t x = 0; x < side; x++) {
+            vertices.push_back({{size * x / (side - 1), size * y / (side - 1), 0.5f}, {1.0f, 1.0f, 1.0f}});
+        }
+    }
+    for (uint32_t y = 0; y + 1 < side; y++) {
+        for (uint32_t x = 0; x + 1 < side; x++) {
+            uint32_t i = y * side + x;
+            indices.insert(indices.end(), {i, i + 1, i + side + 1, i + side + 1, i + side, i});
+        }
+    }
+}
+
+static void benchStartup(Bench &bench) {
+    RollingStats startup, pipeline;
+    startup.window = pipeline.window = bench.reps;
+    for (uint32_t i = 0; i < bench.warmup + bench.reps; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        Vulkan vulkan;
+        createVulkanHeadless(vulkan, "vulkan_bench", false, BENCH_VERT_SHADER, BENCH_FRAG_SHADER);
+        double ms = msSince(start);
+        if (i >= bench.warmup) {
+            startup.add(ms);
+            pipeline.add(vulkan.render.pipelineCreateMs);
+        }
+        destroyVulkan(vulkan);
+    }
+    bench.add("startup.createVulkanHeadless", "ms", startup);
+    bench.add("startup.createGraphicsPipeline", "ms", pipeline);
+}
+
+static void benchUploads(Bench &bench, Vulkan &vulkan) {
+    const uint32_t meshCount = 256;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    makeGrid(32, 0.01f, vertices, indices);
+    double megabytes = (double)meshCount * (vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t)) / (1024.0 * 1024.0);
+
+    RollingStats throughput, meshesPerSecond;
+    throughput.window = meshesPerSecond.window = bench.reps;
+    for (uint32_t i = 0; i < bench.warmup + bench.reps; i++) {
+        MeshArena arena;
+        arena.init(vulkan.handles, sizeof(Vertex), meshCount * (uint32_t)vertices.size(), meshCount * (uint32_t)indices.size());
+        vulkan.recycleFrameUploads();
+
+        // everything createModel does plus getting the data onto the gpu
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t m = 0; m < meshCount; m++) {
+            createModel(arena, vulkan.uploads(), vertices, indices);
+        }
+        vulkan.submitFrameUploads();
+        vulkan.uploads().wait();
+        double seconds = msSince(start) / 1000.0;
+
+        if (i >= bench.warmup) {
+            throughput.add(megabytes / seconds);
+            meshesPerSecond.add(meshCount / seconds);
+        }
+        arena.destroy();
+    }
+    bench.add("upload.createModel", "MB/s", throughput);
+    bench.add("upload.createModel", "meshes/s", meshesPerSecond);
+}
+
+// a fresh directory under the temp dir, unique so concurrent runs (e.g. ctest -j) don't share files
+static std::filesystem::path createScratchDir(char const *prefix) {
+    std::random_device random;
+    while (true) {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / (std::string(prefix) + std::to_string(random()));
+        if (std::filesystem::create_directory(dir)) {
+            return dir;
+        }
+    }
+}
+
+// writes 'files' OBJ grids and loads them all in one batch, parsed and then from their mesh caches.
+// ms per million triangles is the number to watch
+static void benchObjLoad(Bench &bench, ThreadPool &threads, uint32_t files, uint32_t side) {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    makeGrid(side, 1.0f, vertices, indices);
+    std::filesystem::path dir = createScratchDir("vulkan_bench_obj_");
+    std::vector<std::string> paths;
+    for (uint32_t f = 0; f < files; f++) {
+        paths.push_back((dir / ("grid" + std::to_string(f) + ".obj")).string());
+        std::ofstream out(paths.back());
+        for (auto &v : vertices) {
+            out << "v " << v.pos.x << " " << v.pos.y << " " << v.pos.z << "\n";
+        }
+        out << "vn 0 0 1\n";
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            out << "f " << indices[i] + 1 << "//1 " << indices[i + 1] + 1 << "//1 " << indices[i + 2] + 1 << "//1\n";
+        }
+    }
+
+    bench.measure("load.obj." + std::to_string(files) + "x" + std::to_string(indices.size() / 3), "ms/Mtri", [&] {
+        ObjLoadStats stats;
+        loadObjFiles(threads, paths, &stats);
+        return stats.msPerMillionTriangles();
+    });
+    // the warmup writes the caches, every measured run maps them
+    bench.measure("load.meshcache." + std::to_string(files) + "x" + std::to_string(indices.size() / 3), "ms/Mtri", [&] {
+        ObjLoadStats stats;
+        for (auto &cache : loadMeshes(threads, paths, &stats)) {
+            cache.close();
+        }
+        return stats.msPerMillionTriangles();
+    });
+    std::filesystem::remove_all(dir);
+}
+
+static void benchFrames(Bench &bench, Vulkan &vulkan, ThreadPool &threads, uint32_t modelCount, char const *mode) {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    makeGrid(2, 0.01f, vertices, indices); // tiny quads, we're measuring the cpu side
+
+    Scene scene;
+    scene.arena.init(vulkan.handles, sizeof(Vertex), 1024, 1024);
+    vulkan.recycleFrameUploads();
+    Model quad = createModel(scene.arena, vulkan.uploads(), vertices, indices);
+    scene.models.assign(modelCount, quad);
+
+    IndirectDraws indirect;
+    VkParallelRecorder parallel;
+    FrustumCuller culler;
+    if (strcmp(mode, "cull") == 0) {
+        // every other model off screen, so half of them get culled
+        for (uint32_t i = 1; i < modelCount; i += 2) {
+            scene.models[i].transform = glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 0.0f, 0.0f));
+        }
+        culler.init(&threads);
+        culler.cullMs.window = bench.reps;
+        scene.culler = &culler;
+    } else if (strcmp(mode, "indirect") == 0) {
+        indirect.init(vulkan, modelCount, BENCH_INDIRECT_VERT_SHADER, BENCH_FRAG_SHADER);
+        scene.indirect = &indirect;
+    } else if (strcmp(mode, "parallel") == 0) {
+        parallel.init(vulkan.handles, threads);
+        scene.parallel = &parallel;
+    }
+    VkGpuProfiler profiler;
+    profiler.init(vulkan.handles, false);
+    scene.profiler = &profiler;
+
+    std::string name = std::string(mode) + "." + std::to_string(modelCount);
+    bench.measure("record." + name, "ms", [&] {
+        uint32_t imageIndex = vulkan.waitAndPrepForNextFrame();
+        profiler.collect(vulkan.render.currentFrame);
+        auto start = std::chrono::high_resolution_clock::now();
+        recordCommandBuffer(vulkan, imageIndex, scene);
+        double ms = msSince(start);
+        vulkan.submitAndPresent(imageIndex);
+        return ms;
+    });
+    bench.measure("frame." + name, "ms", [&] {
+        auto start = std::chrono::high_resolution_clock::now();
+        drawFrame(vulkan, scene);
+        return msSince(start);
+    });
+    vkDeviceWaitIdle(vulkan.handles.device);
+    for (uint32_t i = 0; i < vulkan.render.framesInFlight; i++) {
+        profiler.collect((vulkan.render.currentFrame + i) % vulkan.render.framesInFlight); // oldest first
+    }
+    if (scene.culler) {
+        bench.add("cull." + std::to_string(modelCount), "ms", culler.cullMs);
+    }
+    auto gpu = profiler.section("renderpass");
+    if (gpu.samples > 0) {
+        std::cout << "  gpu renderpass avg " << gpu.avg << " ms\n";
+    }
+
+    profiler.destroy();
+    if (scene.indirect) {
+        indirect.destroy();
+    }
+    if (scene.parallel) {
+        parallel.destroy();
+    }
+    scene.arena.destroy();
+}
+
+int main(int argc, char **argv) {
+    Bench bench;
+    bool quick = false;
+    char const *jsonPath = "bench_results.json";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+            bench.warmup = 2;
+            bench.reps = 10;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            bench.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            int reps = atoi(argv[++i]);
+            if (reps < 1) {
+                std::cerr << "--reps needs at least 1 repetition, got '" << argv[i] << "'\n";
+                return 1;
+            }
+            bench.reps = (uint32_t)reps;
+        }
+    }
+
+    try {
+        benchStartup(bench);
+
+        Vulkan vulkan;
+        createVulkanHeadless(vulkan, "vulkan_bench", false, BENCH_VERT_SHADER, BENCH_FRAG_SHADER);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(vulkan.handles.physicalDevice, &properties);
+
+        benchUploads(bench, vulkan);
+
+        ThreadPool threads;
+        threads.init();
+        benchObjLoad(bench, threads, quick ? 4 : 16, 256);
+        std::vector<uint32_t> modelCounts = {1, 1000, 10000};
+        if (!quick) {
+            modelCounts.push_back(100000);
+        }
+        for (char const *mode : {"direct", "indirect", "parallel", "cull"}) {
+            for (uint32_t modelCount : modelCounts) {
+                benchFrames(bench, vulkan, threads, modelCount, mode);
+            }
+        }
+        threads.destroy();
+
+        destroyVulkan(vulkan);
+        bench.writeJson(jsonPath, properties.deviceName);
+        std::cout << "wrote " << jsonPath << "\n";
+    } catch (std::exception const &e) {
+        std::cerr << "vulkan_bench failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,118 +1,143 @@
 #include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
 #include <iostream>
 #include "Vulkan.h"
+#include "Upload.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "PipelineCache.h"
+#include "Record.h"
+#include "Profiler.h"
+#include "ObjLoader.h"
+#include "MeshCache.h"
+#include "Culling.h"
+#include "GpuCulling.h"
+#include "Texture.h"
+#include "PipelineCompiler.h"
 #include <GLFW/glfw3.h>
-
-
-void createVertexBuffer(VkHandles vk, std::vector<Vertex> vertices, VkBuffer& vertexBuffer, VkDeviceMemory& vertexBufferMemory) {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    vk.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(vk.device, stagingBufferMemory, 0, bufferSize, 0, &data); {
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-    } vkUnmapMemory(vk.device, stagingBufferMemory);
-
-    vk.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-
-    vk.copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-    vkDestroyBuffer(vk.device, stagingBuffer, nullptr);
-    vkFreeMemory(vk.device, stagingBufferMemory, nullptr);
+#include <glm/gtc/matrix_transform.hpp>
+
+// what the present profile costs: time the cpu spent blocked on frame fences and acquire vs. time the gpu sat between frames
+static void printPresentReport(Vulkan &vulkan, VkGpuProfiler &profiler) {
+    auto cpuWait = profiler.cpuWaitMs.summary();
+    auto gpuIdle = profiler.gpuIdleMs.summary();
+    std::cout << "present profile " << vulkan.present.config.name << ": " << vulkan.render.framesInFlight << " frames in flight, " << (vulkan.frameTimeline ? "timeline" : "fence") << " sync";
+    if (!vulkan.handles.headless) {
+        std::cout << ", " << vulkan.present.swapChainImages.size() << " images, " << presentModeName(vulkan.present.presentMode);
+    }
+    std::cout << "\n  cpu wait avg " << cpuWait.avg << " p99 " << cpuWait.p99 << " ms, gpu idle avg " << gpuIdle.avg << " p99 " << gpuIdle.p99 << " ms\n";
 }
 
-void createIndexBuffer(VkHandles vk, std::vector<uint32_t> indices, VkBuffer& indexBuffer, VkDeviceMemory& indexBufferMemory) {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    vk.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(vk.device, stagingBufferMemory, 0, bufferSize, 0, &data); {
-        memcpy(data, indices.data(), (size_t) bufferSize);
-    } vkUnmapMemory(vk.device, stagingBufferMemory);
-
-    vk.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-
-    vk.copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-    vkDestroyBuffer(vk.device, stagingBuffer, nullptr);
-    vkFreeMemory(vk.device, stagingBufferMemory, nullptr);
+static void printPipelineReport(VkHandles &vk, VkPipelineCompiler &compiler) {
+    PipelineCompileStats const &s = compiler.stats;
+    auto compileMs = s.compileMs.summary();
+    std::cout << "background pipelines: " << s.compiled << " compiled, " << s.failed << " failed, " << s.deduplicated << "/" << s.requested << " requests shared, avg " << compileMs.avg << " p99 " << compileMs.p99 << " ms\n";
+    std::cout << "  shader modules: " << vk.shaderModules->loads << " loaded, " << vk.shaderModules->hits << " reused\n";
 }
 
-struct Model {
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-    size_t numIndices;
-
-    void draw(VkCommandBuffer commandBuffer) {
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(commandBuffer, numIndices, 1, 0, 0, 0);
-    }
-};
-
-Model createModel(Vulkan &vulkan, std::vector<Vertex> vertices, std::vector<uint32_t> indices) {
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    createVertexBuffer(vulkan.handles, vertices, vertexBuffer, vertexBufferMemory);
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-    createIndexBuffer(vulkan.handles, indices, indexBuffer, indexBufferMemory);
-    return {vertexBuffer, vertexBufferMemory, indexBuffer, indexBufferMemory, indices.size()};
+// decode runs on the pool, upload is the frame loop's share
+static void printTextureReport(VkTextureSet &textures) {
+    TextureStats const &s = textures.stats;
+    auto uploadMs = s.uploadMs.summary();
+    std::cout << "textures: " << s.resident << "/" << s.requested << " resident, " << s.failed << " failed" << (textures.mipmapped ? "" : ", no mips (format can't be blitted)") << "\n";
+    std::cout << "  decode " << s.decoded << " images, " << s.decodedBytes / (1024.0 * 1024.0) << " MB in " << s.decodeWallMs << " ms (" << s.decodeMBps() << " MB/s, " << s.decodeThreadMs << " ms on the workers)\n";
+    std::cout << "  upload " << s.uploadedBytes / (1024.0 * 1024.0) << " MB over " << s.uploadFrames << " frames, avg " << uploadMs.avg << " p99 " << uploadMs.p99 << " ms cpu per frame\n";
 }
 
-void recordCommandBuffer(Vulkan &v, uint32_t frameIndex, std::vector<Model> &models) {
-    VkCommandBuffer commandBuffer = v.render.beginRenderpass(v.present, frameIndex); {
-
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, v.render.graphicsPipeline);
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float) v.present.swapChainExtent.width;
-        viewport.height = (float) v.present.swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = v.present.swapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-        for (int i = 0; i < models.size(); i++) {
-            auto &model = models[i];
-            model.draw(commandBuffer);
+int main(int argc, char** argv){
+    // --headless [frames]: render offscreen without a window, e.g. on CI/render nodes. frames >= 1, default 100
+    // --validation / --no-validation: Khronos validation layers, on by default with a window and off headless (render nodes rarely have them)
+    // --indirect: submit the scene with vkCmdDrawIndexedIndirect(Count) instead of a draw per model
+    // --threads [n]: record the draws on n threads (default: all cores) into secondary command buffers
+    // --stats: also collect pipeline statistics, gpu timings are always on
+    // --instances n: also draw n small copies of the second quad with a single instanced draw
+    // --packed: store the meshes as CompactVertex (quantized, half the size) instead of Vertex
+    // --obj path: add an OBJ mesh to the scene, repeatable. all files are loaded in parallel and cached next to the OBJ, see loadMeshes
+    // --cull: frustum cull the models before recording
+    // --gpu-cull: cull and issue the models' draws from a compute shader instead, see VkGpuCuller
+    // --async-compute: with --gpu-cull, run the culling on the compute queue, see VkComputeQueue
+    // --profile name: present profile, low-latency, balanced (default) or throughput, see VkPresentConfig
+    // --frames n / --images n: override the profile's frames in flight (1-4) / swapchain image count
+    // --fences: sync frames with per frame fences even when the device has timeline semaphores
+    // --texture path: load a PNG/JPG into the next texture slot, repeatable. the models sample slot 0, see VkTextureSet
+    // --async-pipelines: compile the pipelines created after startup on the pool, drawing falls back until they're ready, see VkPipelineCompiler
+    std::vector<std::string> objPaths, texturePaths;
+    bool useCulling = false, useGpuCulling = false, useAsyncCompute = false;
+    bool headless = false, useIndirect = false, useThreads = false, pipelineStatistics = false, packed = false;
+    int headlessFrames = 100, threadCount = 0, instanceCount = 0;
+    VkPresentConfig presentConfig = VkPresentConfig::balanced();
+    int framesInFlight = 0, swapChainImages = 0;
+    bool useFences = false, asyncPipelines = false;
+    int validation = -1; // -1: depends on headless
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                headlessFrames = atoi(argv[++i]);
+                if (headlessFrames < 1) {
+                    throw std::runtime_error(std::string("--headless needs at least 1 frame, got '") + argv[i] + "'");
+                }
+            }
+        } else if (strcmp(argv[i], "--validation") == 0) {
+            validation = 1;
+        } else if (strcmp(argv[i], "--no-validation") == 0) {
+            validation = 0;
+        } else if (strcmp(argv[i], "--indirect") == 0) {
+            useIndirect = true;
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instanceCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+            objPaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            texturePaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--async-pipelines") == 0) {
+            asyncPipelines = true;
+        } else if (strcmp(argv[i], "--cull") == 0) {
+            useCulling = true;
+        } else if (strcmp(argv[i], "--gpu-cull") == 0) {
+            useGpuCulling = true;
+        } else if (strcmp(argv[i], "--async-compute") == 0) {
+            useAsyncCompute = true;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            presentConfig = VkPresentConfig::named(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            framesInFlight = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+            swapChainImages = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fences") == 0) {
+            useFences = true;
+        } else if (strcmp(argv[i], "--packed") == 0) {
+            packed = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            pipelineStatistics = true;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            useThreads = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                threadCount = atoi(argv[++i]);
+            }
         }
-    } vkCmdEndRenderPass(commandBuffer);
-
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
     }
-}
-
-void drawFrame(Vulkan &v, std::vector<Model> &models) {
-    auto &h = v.handles;
-    auto &r = v.render;
 
-    uint32_t imageIndex = v.waitAndPrepForNextFrame();
-    recordCommandBuffer(v, imageIndex, models);
-
-    v.submitAndPresent(imageIndex);
-}
-
-int main(int, char**){
-    Vulkan vulkan = createVulkan("Hello, Vulkan!", true, "shaders/vert/passthru.spv", "shaders/frag/passthru.spv");
+    if (framesInFlight > 0) {
+        presentConfig.framesInFlight = framesInFlight;
+    }
+    if (swapChainImages > 0) {
+        presentConfig.swapChainImages = swapChainImages;
+    }
+    presentConfig.timelineSync = !useFences;
+
+    VertexLayout vertexLayout = packed ? VertexLayout::of<CompactVertex>() : VertexLayout::of<Vertex>();
+    bool enableValidationLayers = validation < 0 ? !headless : validation == 1;
+    Vulkan vulkan;
+    if (headless) {
+        createVulkanHeadless(vulkan, "Hello, Vulkan!", enableValidationLayers, "shaders/vert/passthru.spv", "shaders/frag/passthru.spv", 800, 600, vertexLayout, presentConfig);
+    } else {
+        createVulkan(vulkan, "Hello, Vulkan!", enableValidationLayers, "shaders/vert/passthru.spv", "shaders/frag/passthru.spv", vertexLayout, presentConfig);
+    }
     std::cout << "Hello, from Vulkan!\n";
+    std::cout << "uploads go through the " << (vulkan.handles.asyncTransfer() ? "async transfer" : "graphics") << " queue\n";
 
     const std::vector<Vertex> vertices0 = {
         {{-0.75f, -0.75f, 0.f}, {1.0f, 0.0f, 0.0f}},
@@ -135,12 +160,177 @@ int main(int, char**){
     const std::vector<uint32_t> indices1 = { 
         0, 1, 2, 2, 3, 0
     };
-    std::vector<Model> models = {createModel(vulkan, vertices0, indices0), createModel(vulkan, vertices1, indices1)};
+    // both models share one vertex and one index buffer; their uploads go through the frame's
+    // slice of the staging ring and are submitted ahead of the first frame's draws
+    // the pool loads the OBJ files, decodes the textures, compiles pipelines and, with --threads, records the draws: its workers plus the main thread each record a chunk
+    ThreadPool threads;
+    if (useThreads || !objPaths.empty() || !texturePaths.empty() || asyncPipelines) {
+        threads.init(threadCount > 0 ? threadCount - 1 : ThreadPool::defaultThreadCount());
+    }
+    std::vector<MeshCacheFile> objMeshes;
+    if (!objPaths.empty()) {
+        objMeshes = loadMeshes(threads, objPaths);
+    }
+
+    // 16 bit indices unless a mesh is too big for them
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    for (auto &mesh : objMeshes) {
+        if (mesh.header->indexType != VK_INDEX_TYPE_UINT16) {
+            indexType = VK_INDEX_TYPE_UINT32;
+        }
+    }
 
+    Scene scene;
+    if (packed) {
+        scene.arena.init(vulkan.handles, sizeof(CompactVertex), 64 * 1024, 256 * 1024, indexType);
+        scene.models = {createPackedModel<CompactVertex>(scene.arena, vulkan.uploads(), vertices0, indices0), createPackedModel<CompactVertex>(scene.arena, vulkan.uploads(), vertices1, indices1)};
+        for (auto &mesh : objMeshes) {
+            MeshCacheHeader const &h = *mesh.header;
+            scene.models.push_back(h.indexType == VK_INDEX_TYPE_UINT16 ? createPackedModel<CompactVertex>(scene.arena, vulkan.uploads(), mesh.vertices(), h.vertexCount, (uint16_t const *)mesh.indices(), h.indexCount, mesh.bounds())
+                                                                       : createPackedModel<CompactVertex>(scene.arena, vulkan.uploads(), mesh.vertices(), h.vertexCount, (uint32_t const *)mesh.indices(), h.indexCount, mesh.bounds()));
+        }
+    } else {
+        scene.arena.init(vulkan.handles, sizeof(Vertex), 64 * 1024, 256 * 1024, indexType);
+        scene.models = {createModel(scene.arena, vulkan.uploads(), vertices0, indices0), createModel(scene.arena, vulkan.uploads(), vertices1, indices1)};
+        for (auto &mesh : objMeshes) {
+            scene.models.push_back(createModel(scene.arena, vulkan.uploads(), mesh));
+        }
+    }
+    for (auto &mesh : objMeshes) {
+        mesh.close(); // staged already
+    }
+
+    // a grid of shrunken copies of the second quad, all in one draw
+    InstanceBuffer instanceBuffer;
+    if (instanceCount > 0) {
+        createInstancedPipeline(vulkan, "shaders/vert/instanced.spv", "shaders/frag/passthru.spv");
+        instanceBuffer.init(vulkan.handles, instanceCount);
+        scene.instanceBuffer = &instanceBuffer;
+
+        InstancedModel grid{scene.models[1].mesh, scene.models[1].meshTransform, {}};
+        uint32_t side = (uint32_t)ceil(sqrt((double)instanceCount));
+        float cell = 2.0f / side;
+        for (int i = 0; i < instanceCount; i++) {
+            glm::vec3 center(-1.0f + cell * (i % side + 0.5f), -1.0f + cell * (i / side + 0.5f), 0.0f);
+            glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(cell * 0.8f, cell * 0.8f, 1.0f));
+            grid.instances.push_back({transform, glm::vec4((float)(i % side) / side, (float)(i / side) / side, 1.0f, 1.0f)});
+        }
+        scene.instancedModels.push_back(grid);
+    }
+
+    IndirectDraws indirectDraws;
+    if (useIndirect) {
+        indirectDraws.init(vulkan, 128 * 1024, "shaders/vert/indirect.spv", "shaders/frag/passthru.spv");
+        scene.indirect = &indirectDraws;
+    }
+
+    VkGpuProfiler profiler;
+    profiler.init(vulkan.handles, pipelineStatistics);
+    scene.profiler = &profiler;
+
+    FrustumCuller culler;
+    if (useCulling) {
+        culler.init(&threads);
+        scene.culler = &culler;
+    }
+
+    // the objects go up once here, after that only models[1]'s transform is re-sent as it moves
+    VkGpuCuller gpuCuller;
+    if (useGpuCulling) {
+        gpuCuller.init(vulkan, 64 * 1024, "shaders/comp/cull.spv", "shaders/vert/gpu_culled.spv", "shaders/frag/passthru.spv");
+        gpuCuller.setObjects(vulkan.uploads(), scene.models, scene.arena);
+        scene.gpuCuller = &gpuCuller;
+    }
+    VkComputeQueue computeQueue;
+    if (useGpuCulling && useAsyncCompute) {
+        computeQueue.init(vulkan);
+        scene.compute = &computeQueue;
+        std::cout << "culling on the " << (vulkan.handles.asyncCompute() ? "async compute" : "graphics") << " queue family\n";
+    }
+
+    // decoding starts right away on the pool, the frames below pick the images up as they finish
+    VkPipelineCompiler pipelineCompiler;
+    if (asyncPipelines) {
+        pipelineCompiler.init(vulkan, threads);
+    }
+    VkTextureSet textureSet;
+    if (!texturePaths.empty()) {
+        textureSet.init(vulkan, threads, 16 /* TEXTURE_SLOTS in textured.glsl */, "shaders/vert/textured.spv", "shaders/frag/textured.spv", asyncPipelines ? &pipelineCompiler : nullptr);
+        for (uint32_t i = 0; i < texturePaths.size(); i++) {
+            textureSet.load(i, texturePaths[i]);
+        }
+        scene.textures = &textureSet;
+    }
+
+    VkParallelRecorder parallelRecorder;
+    if (useThreads) {
+        parallelRecorder.init(vulkan.handles, threads);
+        scene.parallel = &parallelRecorder;
+    }
+
+    if (headless) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < headlessFrames; i++) {
+            drawFrame(vulkan, scene);
+        }
+        vkDeviceWaitIdle(vulkan.handles.device);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "rendered " << headlessFrames << " headless frames, " << elapsed.count() / headlessFrames << " ms/frame\n";
+        for (uint32_t i = 0; i < vulkan.render.framesInFlight; i++) {
+            profiler.collect((vulkan.render.currentFrame + i) % vulkan.render.framesInFlight); // the frames still in flight when the loop ended, oldest first
+        }
+        printPresentReport(vulkan, profiler);
+        if (scene.textures) {
+            printTextureReport(textureSet);
+        }
+        if (asyncPipelines) {
+            pipelineCompiler.waitIdle();
+            printPipelineReport(vulkan.handles, pipelineCompiler);
+        }
+        for (auto &section : profiler.report()) {
+            std::cout << "gpu " << section.name << ": min " << section.ms.min << " avg " << section.ms.avg << " p99 " << section.ms.p99 << " ms\n";
+        }
+        if (profiler.statistics) {
+            auto &stats = profiler.lastStatistics;
+            std::cout << "last frame: " << stats.vertexShaderInvocations << " vertex invocations, " << stats.clippingPrimitives << " clipped primitives, " << stats.fragmentShaderInvocations << " fragment invocations\n";
+        }
+        if (scene.culler) {
+            auto cullMs = culler.cullMs.summary();
+            std::cout << "culling: " << culler.stats.visible << " visible, " << culler.stats.culled << " culled, avg " << cullMs.avg << " ms p99 " << cullMs.p99 << " ms\n";
+        }
+        savePipelineCache(vulkan.handles);
+        if (scene.textures) {
+            textureSet.destroy(); // waits for decodes still running on the pool
+        }
+        threads.destroy(); // before the locals its jobs point at go away
+        return 0;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
     while (!glfwWindowShouldClose(vulkan.handles.window)) {
         glfwPollEvents();
-        drawFrame(vulkan, models);
+        // slide the second quad back and forth, only its push constant changes
+        float t = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - startTime).count();
+        scene.models[1].transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.25f * sin(t), 0.0f, 0.0f));
+        if (scene.gpuCuller) {
+            gpuCuller.updateObject(1, scene.models[1], scene.arena);
+        }
+        drawFrame(vulkan, scene);
+    }
+    printPresentReport(vulkan, profiler);
+    if (scene.textures) {
+        printTextureReport(textureSet);
+    }
+    if (asyncPipelines) {
+        pipelineCompiler.waitIdle();
+        printPipelineReport(vulkan.handles, pipelineCompiler);
     }
 
+    savePipelineCache(vulkan.handles);
+    vkDeviceWaitIdle(vulkan.handles.device);
+    if (scene.textures) {
+        textureSet.destroy();
+    }
+    threads.destroy();
     return 0;
 }
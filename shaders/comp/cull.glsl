@@ -0,0 +1,70 @@
+#version 450
+
+// frustum culls every object and writes indirect draws for the survivors, see VkGpuCuller
+layout(local_size_x = 64) in;
+
+struct GpuObject {
+    mat4 transform;
+    mat4 meshTransform;
+    vec4 sphere;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint pad;
+};
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects {
+    GpuObject objects[];
+};
+
+layout(std430, set = 0, binding = 1) writeonly buffer Draws {
+    DrawCommand draws[];
+};
+
+layout(std430, set = 0, binding = 2) buffer Count {
+    uint drawCount;
+};
+
+layout(push_constant) uniform CullConstants {
+    vec4 planes[6];
+    uint objectCount;
+    uint compact;
+} cull;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= cull.objectCount) {
+        if (cull.compact == 0 && i < draws.length()) {
+            draws[i] = DrawCommand(0, 0, 0, 0, 0);
+        }
+        return;
+    }
+
+    GpuObject object = objects[i];
+    vec3 center = (object.transform * vec4(object.sphere.xyz, 1.0)).xyz;
+    float scale2 = max(max(dot(object.transform[0].xyz, object.transform[0].xyz), dot(object.transform[1].xyz, object.transform[1].xyz)), dot(object.transform[2].xyz, object.transform[2].xyz));
+    float radius = object.sphere.w * sqrt(scale2);
+
+    bool visible = true;
+    for (int p = 0; p < 6; p++) {
+        visible = visible && dot(cull.planes[p].xyz, center) + cull.planes[p].w >= -radius;
+    }
+
+    // firstInstance = object index, gpu_culled.glsl finds the transforms through gl_InstanceIndex
+    if (cull.compact != 0) {
+        if (visible) {
+            uint slot = atomicAdd(drawCount, 1);
+            draws[slot] = DrawCommand(object.indexCount, 1, object.firstIndex, object.vertexOffset, i);
+        }
+    } else {
+        draws[i] = DrawCommand(object.indexCount, visible ? 1 : 0, object.firstIndex, object.vertexOffset, i);
+    }
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// see VkTextureSet, slots that aren't loaded yet are a white placeholder
+#define TEXTURE_SLOTS 16
+layout(set = 1, binding = 0) uniform sampler2D textures[TEXTURE_SLOTS];
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUv;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = vec4(fragColor, 1.0) * texture(textures[0], fragUv);
+}
@@ -0,0 +1,32 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+// same objects the cull shader read, firstInstance of each draw is the object's index
+struct GpuObject {
+    mat4 transform;
+    mat4 meshTransform;
+    vec4 sphere;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint pad;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Objects {
+    GpuObject objects[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    GpuObject object = objects[gl_InstanceIndex];
+    gl_Position = frame.proj * frame.view * object.transform * object.meshTransform * vec4(inPosition, 1.0);
+    fragColor = inColor;
+}
@@ -0,0 +1,21 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+// one per draw, written by IndirectDraws::add. firstInstance of each draw is its index
+layout(std430, set = 1, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = frame.proj * frame.view * transforms[gl_InstanceIndex] * vec4(inPosition, 1.0);
+    fragColor = inColor;
+}
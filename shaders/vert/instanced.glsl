@@ -0,0 +1,25 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+// InstancedModel::meshTransform, identity unless the mesh is quantized
+layout(push_constant) uniform DrawPushConstants {
+    mat4 model;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// per instance (binding 1), see InstanceData
+layout(location = 2) in mat4 instanceTransform;
+layout(location = 6) in vec4 instanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = frame.proj * frame.view * instanceTransform * draw.model * vec4(inPosition, 1.0);
+    fragColor = inColor * instanceColor.rgb;
+}
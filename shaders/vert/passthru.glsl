@@ -1,10 +1,15 @@
 #version 450
 
-// layout(binding = 0) uniform UniformBufferObject {
-//     mat4 model;
-//     mat4 view;
-//     mat4 proj;
-// } ubo;
+// set 0 is bound once per frame at a dynamic offset into the uniform ring, see FrameUniforms
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+// see DrawPushConstants
+layout(push_constant) uniform DrawPushConstants {
+    mat4 model;
+} draw;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -12,6 +17,6 @@ layout(location = 1) in vec3 inColor;
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = vec4(inPosition, 1.0);
+    gl_Position = frame.proj * frame.view * draw.model * vec4(inPosition, 1.0);
     fragColor = inColor;
-}
\ No newline at end of file
+}
@@ -0,0 +1,25 @@
+#version 450
+
+// set 0 is bound once per frame at a dynamic offset into the uniform ring, see FrameUniforms
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+// see DrawPushConstants
+layout(push_constant) uniform DrawPushConstants {
+    mat4 model;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUv;
+
+void main() {
+    gl_Position = frame.proj * frame.view * draw.model * vec4(inPosition, 1.0);
+    fragColor = inColor;
+    // the vertex formats carry no texture coordinates, project the model's xy plane instead
+    fragUv = inPosition.xy * 0.5 + 0.5;
+}
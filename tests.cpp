@@ -0,0 +1,160 @@
+// CPU side unit tests for vulkan_core, no device needed. Run by ctest as vulkan_core_tests.
+#include "Memory.h"
+#include "MeshOptimize.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                         \
+    do {                                                                                    \
+        if (!(cond)) {                                                                      \
+            std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            failures++;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+// size x size quads, two triangles each, emitted row by row
+static void makeGrid(uint32_t size, std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+    vertices.clear();
+    indices.clear();
+    for (uint32_t y = 0; y <= size; y++) {
+        for (uint32_t x = 0; x <= size; x++) {
+            vertices.push_back({glm::vec3((float)x, (float)y, 0.0f), glm::vec3(1.0f)});
+        }
+    }
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            uint32_t v = y * (size + 1) + x;
+            indices.insert(indices.end(), {v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1});
+        }
+    }
+}
+
+static void shuffleTriangles(std::vector<uint32_t> &indices) {
+    std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+    for (size_t t = 0; t < triangles.size(); t++) {
+        triangles[t] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1234));
+    for (size_t t = 0; t < triangles.size(); t++) {
+        std::copy(triangles[t].begin(), triangles[t].end(), indices.begin() + 3 * t);
+    }
+}
+
+// triangles rotated to start at their smallest index (keeping the winding), then sorted
+static std::vector<std::array<uint32_t, 3>> triangleSet(std::vector<uint32_t> const &indices) {
+    std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+    for (size_t t = 0; t < triangles.size(); t++) {
+        std::array<uint32_t, 3> tri = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+        std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+        triangles[t] = tri;
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+static void testVertexCacheOrder() {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    makeGrid(32, vertices, indices);
+    shuffleTriangles(indices);
+    uint32_t vertexCount = (uint32_t)vertices.size();
+
+    VertexCacheStats before = analyzeVertexCache(indices, vertexCount);
+    std::vector<uint32_t> hardBoundaries;
+    std::vector<uint32_t> optimized = optimizeVertexCache(indices, vertexCount, DEFAULT_VERTEX_CACHE_SIZE, &hardBoundaries);
+    VertexCacheStats after = analyzeVertexCache(optimized, vertexCount);
+    CHECK(optimized.size() == indices.size());
+    CHECK(triangleSet(optimized) == triangleSet(indices));
+    CHECK(after.acmr <= before.acmr);
+    CHECK(after.acmr < 1.0f); // a shuffled grid starts near 3, tipsify gets well under 1
+
+    optimizeOverdraw(optimized, vertices, hardBoundaries);
+    CHECK(triangleSet(optimized) == triangleSet(indices));
+}
+
+static void testOptimizeMesh() {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    makeGrid(16, vertices, indices);
+    std::vector<Vertex> original = vertices;
+    std::vector<uint32_t> originalIndices = indices;
+
+    MeshOptimizeReport report = optimizeMesh(vertices, indices);
+    CHECK(report.after.acmr <= report.before.acmr);
+    CHECK(vertices.size() == original.size());
+    CHECK(indices.size() == originalIndices.size());
+
+    // vertices were reordered too, so map every index back to its original vertex by position
+    std::vector<uint32_t> restored;
+    for (uint32_t v : indices) {
+        glm::vec3 pos = vertices[v].pos;
+        auto it = std::find_if(original.begin(), original.end(), [&](Vertex const &o) { return o.pos == pos; });
+        restored.push_back((uint32_t)(it - original.begin()));
+    }
+    CHECK(triangleSet(restored) == triangleSet(originalIndices));
+
+    // vertex fetch order: vertices appear in order of first use
+    uint32_t next = 0;
+    for (uint32_t v : indices) {
+        CHECK(v <= next);
+        next = std::max(next, v + 1);
+    }
+}
+
+static void testEmptyMesh() {
+    std::vector<Vertex> vertices = {{glm::vec3(0.0f), glm::vec3(1.0f)}};
+    std::vector<uint32_t> indices;
+    VertexCacheStats stats = analyzeVertexCache(indices, 1);
+    CHECK(stats.acmr == 0.0f && stats.atvr == 0.0f);
+    CHECK(optimizeVertexCache(indices, 0).empty());
+
+    MeshOptimizeReport report = optimizeMesh(vertices, indices);
+    CHECK(indices.empty());
+    CHECK(report.clusters == 0);
+    CHECK(report.before.acmr == 0.0f && report.after.acmr == 0.0f);
+}
+
+static void testNarrowIndices() {
+    std::vector<uint16_t> narrowed;
+    CHECK(narrowIndices({0, 1, UINT16_MAX}, narrowed));
+    CHECK((narrowed == std::vector<uint16_t>{0, 1, UINT16_MAX}));
+    CHECK(!narrowIndices({0, UINT16_MAX + 1u}, narrowed));
+    CHECK(narrowed.size() == 3); // untouched
+}
+
+static void testRangeAllocator() {
+    VkRangeAllocator ranges;
+    ranges.init(1024);
+    VkDeviceSize a = 0, b = 0, c = 0;
+    CHECK(ranges.alloc(100, 1, a) && a == 0);
+    CHECK(ranges.alloc(100, 256, b) && b == 256);
+    CHECK(!ranges.alloc(1024, 1, c));
+    ranges.free(a, 100);
+    ranges.free(b, 100);
+    CHECK(ranges.used == 0);
+    CHECK(ranges.freeRanges.size() == 1 && ranges.largestFreeRange() == 1024);
+
+    CHECK(ranges.alloc(1024, 1, c) && c == 0);
+    ranges.grow(2048);
+    CHECK(ranges.used == 1024 && ranges.largestFreeRange() == 1024);
+}
+
+int main() {
+    testVertexCacheOrder();
+    testOptimizeMesh();
+    testEmptyMesh();
+    testNarrowIndices();
+    testRangeAllocator();
+    if (failures > 0) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all tests passed" << std::endl;
+    return 0;
+}